@@ -0,0 +1,484 @@
+// 无锁的多生产者多消费者队列（Michael-Scott队列），节点的组织方式和List相同：元素直接构造在节点中，节点之间单向链接
+// 队列始终有一个不含元素的哑节点作为head，入队只修改tail，出队只修改head，生产者和消费者之间互不阻塞
+// 出队后的节点可能仍被其他线程读取，先退役（retire），由风险指针（hazard pointer）确认没有线程在访问后才释放
+// 也可以只有一个消费者（MPSC），接口相同
+
+#ifndef CONCURRENTQUEUE_CPP
+#define CONCURRENTQUEUE_CPP
+
+#pragma push_macro("NO_MAIN") //只引入实现，不引入它们的测试代码
+#define NO_MAIN
+#include "Vec.cpp"
+#pragma pop_macro("NO_MAIN")
+#include <atomic>
+#include <thread>
+#include <functional>
+#include <algorithm>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <assert.h>
+#include <crtdbg.h>
+
+using namespace std;
+
+#ifndef BENCHMARK
+#define DEBUG
+#endif
+
+
+// 和List的Node一样，元素在节点中原地构造；哑节点不构造元素，所以元素放在未初始化的内存中，T不需要默认构造函数
+template <typename T>
+struct QueueNode
+{
+    atomic<QueueNode*> next;
+    typename aligned_storage<sizeof(T), alignof(T)>::type slot;
+
+    QueueNode(): next(nullptr) {}
+    T* val() { return reinterpret_cast<T*>(&slot); }
+};
+
+
+// 每个正在操作队列的线程占用一条记录：两个风险指针和它退役的节点
+// 记录之间用pad隔开一个缓存行，避免不同线程发布风险指针时互相使缓存行失效
+template <typename T>
+struct HazardRecord
+{
+    atomic<bool> active;
+    atomic<QueueNode<T>*> hazard[2];
+    Vec<QueueNode<T>*> retired; //只有占用记录的线程访问
+    char pad[64];
+
+    HazardRecord(): active(false) { hazard[0] = nullptr; hazard[1] = nullptr; }
+};
+
+
+template <typename T>
+class ConcurrentQueue
+{
+public:
+    ConcurrentQueue();
+    ConcurrentQueue(const ConcurrentQueue&) = delete;
+    ConcurrentQueue& operator=(const ConcurrentQueue&) = delete;
+    ~ConcurrentQueue(); //调用时不能再有其他线程访问队列
+
+    void push(const T& val) { emplace(val); }
+    void push(T&& val) { emplace(std::move(val)); }
+    template <typename... Args>
+    void emplace(Args&&... args);
+    bool try_pop(T& out); //队列为空时返回false，不等待
+    bool empty() const; //并发时只是一个瞬间的快照
+
+    static const size_t MaxRecords = 64; //同时操作队列的线程数上限，超过时后来的线程等待空闲的记录
+
+private:
+    typedef QueueNode<T> Node;
+    typedef Node* Ptr;
+
+    HazardRecord<T>* acquire() const;
+    static void release(HazardRecord<T>* rec);
+    static Ptr protect(HazardRecord<T>* rec, int i, const atomic<Ptr>& src);
+    void retire(HazardRecord<T>* rec, Ptr p);
+    void scan(HazardRecord<T>* rec);
+
+    // head和tail分别被消费者和生产者频繁修改，放在不同的缓存行上
+    atomic<Ptr> head;
+    char pad1[64];
+    atomic<Ptr> tail;
+    char pad2[64];
+    mutable HazardRecord<T> records[MaxRecords]; //empty()这样的只读操作也要登记风险指针
+};
+
+template <typename T>
+const size_t ConcurrentQueue<T>::MaxRecords;
+
+
+
+/* 公有成员函数的实现 */
+
+template <typename T>
+ConcurrentQueue<T>::ConcurrentQueue()
+{
+    Ptr dummy = new Node;
+    head.store(dummy);
+    tail.store(dummy);
+}
+
+// head之后的节点都还保存着元素，head本身是哑节点
+template <typename T>
+ConcurrentQueue<T>::~ConcurrentQueue()
+{
+    Ptr p = head.load();
+    for (Ptr next; (next = p->next.load()) != nullptr; p = next)
+    {
+        next->val()->~T();
+        delete p;
+    }
+    delete p;
+
+    for (size_t i = 0; i < MaxRecords; ++i)
+        for (size_t j = 0; j < records[i].retired.size(); ++j)
+            delete records[i].retired[j];
+}
+
+// 先把新节点链到tail->next上，再尝试推进tail；推进失败说明别的线程已经帮忙推进了
+template <typename T>
+template <typename... Args>
+void ConcurrentQueue<T>::emplace(Args&&... args)
+{
+    Ptr node = new Node;
+    ::new (static_cast<void*>(node->val())) T(std::forward<Args>(args)...);
+
+    HazardRecord<T>* rec = acquire();
+    for (;;)
+    {
+        Ptr t = protect(rec, 0, tail);
+        Ptr next = t->next.load();
+        if (t != tail.load())
+            continue;
+        if (next != nullptr)
+        {
+            tail.compare_exchange_weak(t, next); //tail落后了，帮上一个生产者推进
+            continue;
+        }
+        if (t->next.compare_exchange_weak(next, node))
+        {
+            tail.compare_exchange_strong(t, node);
+            break;
+        }
+    }
+    rec->hazard[0].store(nullptr);
+    release(rec);
+}
+
+// 元素保存在head的后继中：先把head换成后继，成功的线程才取走元素，后继随之成为新的哑节点
+// 取元素时仍用风险指针保护后继，防止别的消费者紧接着把它出队并释放
+template <typename T>
+bool ConcurrentQueue<T>::try_pop(T& out)
+{
+    HazardRecord<T>* rec = acquire();
+    Ptr h;
+    Ptr next;
+    for (;;)
+    {
+        h = protect(rec, 0, head);
+        Ptr t = tail.load();
+        next = protect(rec, 1, h->next);
+        if (h != head.load())
+            continue;
+        if (next == nullptr)
+        {
+            rec->hazard[0].store(nullptr);
+            rec->hazard[1].store(nullptr);
+            release(rec);
+            return false;
+        }
+        if (h == t)
+        {
+            tail.compare_exchange_weak(t, next); //生产者还没来得及推进tail，不能让head越过tail
+            continue;
+        }
+        if (head.compare_exchange_weak(h, next))
+            break;
+    }
+
+    out = std::move(*next->val());
+    next->val()->~T();
+    rec->hazard[0].store(nullptr);
+    rec->hazard[1].store(nullptr);
+    retire(rec, h);
+    release(rec);
+    return true;
+}
+
+// 读取head的后继之前也要用风险指针保护head，否则它可能已经被别的消费者出队并释放
+template <typename T>
+bool ConcurrentQueue<T>::empty() const
+{
+    HazardRecord<T>* rec = acquire();
+    Ptr h = protect(rec, 0, head);
+    bool result = h->next.load() == nullptr;
+    rec->hazard[0].store(nullptr);
+    release(rec);
+    return result;
+}
+
+
+
+/* 私有成员函数的实现 */
+
+// 从按线程散列的位置开始找一条空闲的记录，线程数不多时几乎总是一次成功
+template <typename T>
+HazardRecord<T>* ConcurrentQueue<T>::acquire() const
+{
+    static thread_local size_t start = std::hash<thread::id>()(this_thread::get_id()) % MaxRecords;
+    for (size_t i = start; ; i = (i + 1) % MaxRecords)
+    {
+        bool expected = false;
+        if (!records[i].active.load(memory_order_relaxed) && records[i].active.compare_exchange_strong(expected, true, memory_order_acquire))
+        {
+            start = i;
+            return &records[i];
+        }
+        if ((i + 1) % MaxRecords == start)
+            this_thread::yield();
+    }
+}
+
+template <typename T>
+void ConcurrentQueue<T>::release(HazardRecord<T>* rec)
+{
+    rec->active.store(false, memory_order_release);
+}
+
+// 发布风险指针后重新读取src，两次一致才说明发布时节点还没有被退役，此后它不会被释放
+// 发布和重新读取之间需要StoreLoad顺序，这里都使用默认的seq_cst
+template <typename T>
+typename ConcurrentQueue<T>::Ptr ConcurrentQueue<T>::protect(HazardRecord<T>* rec, int i, const atomic<Ptr>& src)
+{
+    Ptr p = src.load();
+    for (;;)
+    {
+        rec->hazard[i].store(p);
+        Ptr again = src.load();
+        if (again == p)
+            return p;
+        p = again;
+    }
+}
+
+// 退役的节点攒够一批再扫描，平摊每次扫描的开销；阈值大于风险指针总数，保证每次扫描至少释放一半
+template <typename T>
+void ConcurrentQueue<T>::retire(HazardRecord<T>* rec, Ptr p)
+{
+    rec->retired.push_back(p);
+    if (rec->retired.size() >= 4 * MaxRecords)
+        scan(rec);
+}
+
+template <typename T>
+void ConcurrentQueue<T>::scan(HazardRecord<T>* rec)
+{
+    Vec<Ptr> hazards;
+    hazards.reserve(2 * MaxRecords);
+    for (size_t i = 0; i < MaxRecords; ++i)
+        for (int j = 0; j < 2; ++j)
+        {
+            Ptr p = records[i].hazard[j].load();
+            if (p != nullptr)
+                hazards.push_back(p);
+        }
+    sort(hazards.begin(), hazards.end());
+
+    Vec<Ptr>& retired = rec->retired;
+    size_t kept = 0;
+    for (size_t i = 0; i < retired.size(); ++i)
+    {
+        if (binary_search(hazards.begin(), hazards.end(), retired[i]))
+            retired[kept++] = retired[i];
+        else
+            delete retired[i];
+    }
+    retired.erase(retired.begin() + kept, retired.end());
+}
+
+
+
+/* 测试代码 */
+
+// 被其他文件include时，定义NO_MAIN来跳过这里的测试代码和性能测试代码
+#if defined(DEBUG) && !defined(NO_MAIN)
+
+#include <memory>
+#include <string>
+
+// 统计存活的对象数，检查出队和析构时元素既没有泄漏也没有被析构两次
+struct Tracked
+{
+    static atomic<int> alive;
+    int v;
+    Tracked(int x = 0): v(x) { ++alive; }
+    Tracked(const Tracked& t): v(t.v) { ++alive; }
+    Tracked& operator=(const Tracked& t) { v = t.v; return *this; }
+    ~Tracked() { --alive; }
+};
+atomic<int> Tracked::alive(0);
+
+
+int main(int argc, char* argv[])
+{
+    {
+        ConcurrentQueue<int> q1;
+        int x = -1;
+        assert(q1.empty() && !q1.try_pop(x) && x == -1);
+        for (int i = 0; i < 1000; ++i)
+            q1.push(i);
+        assert(!q1.empty());
+        for (int i = 0; i < 1000; ++i)
+            assert(q1.try_pop(x) && x == i); //单线程时就是先进先出
+        assert(q1.empty() && !q1.try_pop(x));
+
+        ConcurrentQueue<unique_ptr<string> > q2; //只能移动的类型
+        q2.push(unique_ptr<string>(new string("first")));
+        q2.emplace(new string("second"));
+        unique_ptr<string> s;
+        assert(q2.try_pop(s) && *s == "first" && q2.try_pop(s) && *s == "second" && !q2.try_pop(s));
+        q2.emplace(new string("left in queue")); //析构时释放
+
+        {
+            ConcurrentQueue<Tracked> q3;
+            for (int i = 0; i < 10; ++i)
+                q3.emplace(i);
+            Tracked t;
+            for (int i = 0; i < 4; ++i)
+                assert(q3.try_pop(t) && t.v == i);
+            assert(Tracked::alive == 7);
+        }
+        assert(Tracked::alive == 0);
+    }
+
+    {
+        // 多个生产者和消费者：每个元素恰好被取出一次，同一生产者的元素按入队顺序被取出
+        const int producers = 4, consumers = 4, per = 20000;
+        ConcurrentQueue<pair<int, int> > q;
+        atomic<int> remaining(producers * per);
+        atomic<long long> sum(0);
+        atomic<bool> ordered(true);
+        Vec<thread> threads;
+        threads.push_back(thread([&q, &remaining]() { //观察者在元素不断出队时反复调用empty()
+            while (remaining.load() > 0)
+                q.empty();
+        }));
+        for (int p = 0; p < producers; ++p)
+            threads.push_back(thread([&q, p, per]() {
+                for (int i = 0; i < per; ++i)
+                    q.push(make_pair(p, i));
+            }));
+        for (int c = 0; c < consumers; ++c)
+            threads.push_back(thread([&]() {
+                int last[producers];
+                fill(last, last + producers, -1);
+                pair<int, int> item;
+                while (remaining.load() > 0)
+                {
+                    if (!q.try_pop(item))
+                    {
+                        this_thread::yield();
+                        continue;
+                    }
+                    if (item.second <= last[item.first])
+                        ordered = false;
+                    last[item.first] = item.second;
+                    sum += item.second;
+                    --remaining;
+                }
+            }));
+        for (size_t i = 0; i < threads.size(); ++i)
+            threads[i].join();
+
+        pair<int, int> item;
+        assert(remaining == 0 && ordered && !q.try_pop(item));
+        assert(sum == (long long)producers * per * (per - 1) / 2);
+    }
+
+    _CrtDumpMemoryLeaks();
+}
+
+#endif // DEBUG
+
+
+/* 性能测试代码 */
+
+#if defined(BENCHMARK) && !defined(NO_MAIN)
+
+#pragma push_macro("NO_MAIN")
+#define NO_MAIN
+#include "List.cpp"
+#pragma pop_macro("NO_MAIN")
+#include <mutex>
+#include <chrono>
+#include <cstdlib>
+
+// 现在的做法：用互斥锁保护的List
+template <typename T>
+class LockedList
+{
+public:
+    void push(const T& val)
+    {
+        lock_guard<mutex> lock(m);
+        list.push_back(val);
+    }
+    bool try_pop(T& out)
+    {
+        lock_guard<mutex> lock(m);
+        if (list.empty())
+            return false;
+        out = *list.begin();
+        list.pop_front();
+        return true;
+    }
+
+private:
+    mutex m;
+    List<T> list;
+};
+
+
+// 生产者各自入队per个元素，消费者取完为止，返回每秒处理的元素数
+template <typename Q>
+double run(int producers, int consumers, size_t per)
+{
+    Q q;
+    atomic<long long> remaining((long long)(producers * per));
+    atomic<size_t> sink(0);
+    Vec<thread> threads;
+    auto start = chrono::steady_clock::now();
+    for (int p = 0; p < producers; ++p)
+        threads.push_back(thread([&q, per]() {
+            for (size_t i = 0; i < per; ++i)
+                q.push(i);
+        }));
+    for (int c = 0; c < consumers; ++c)
+        threads.push_back(thread([&]() {
+            size_t item, acc = 0;
+            while (remaining.load(memory_order_relaxed) > 0)
+            {
+                if (q.try_pop(item))
+                {
+                    acc += item;
+                    remaining.fetch_sub(1, memory_order_relaxed);
+                }
+            }
+            sink += acc;
+        }));
+    for (size_t i = 0; i < threads.size(); ++i)
+        threads[i].join();
+    double sec = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return producers * per / sec;
+}
+
+
+int main(int argc, char* argv[])
+{
+    size_t total = argc > 1 ? strtoul(argv[1], nullptr, 10) : 4000000;
+    int cores = int(thread::hardware_concurrency());
+    if (cores < 2)
+        cores = 2;
+
+    cout << "total " << total << " items, ops/s (million)" << endl;
+    for (int producers = 1; producers <= cores; producers = (producers * 2 > cores && producers < cores) ? cores : producers * 2) //1, 2, 4...，最后一行总是用全部核心
+    {
+        size_t per = total / producers;
+        cout << producers << " producer(s), 1 consumer: List+mutex " << run<LockedList<size_t> >(producers, 1, per) / 1e6
+             << ", ConcurrentQueue " << run<ConcurrentQueue<size_t> >(producers, 1, per) / 1e6 << endl;
+        if (producers > 1)
+            cout << producers << " producer(s), " << producers << " consumer(s): List+mutex "
+                 << run<LockedList<size_t> >(producers, producers, per) / 1e6
+                 << ", ConcurrentQueue " << run<ConcurrentQueue<size_t> >(producers, producers, per) / 1e6 << endl;
+    }
+}
+
+#endif // BENCHMARK
+
+#endif // CONCURRENTQUEUE_CPP
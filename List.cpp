@@ -1,13 +1,25 @@
 // STL的list是采用双向循环链表实现的
 
+#ifndef LIST_CPP
+#define LIST_CPP
+
 #include <iostream>
 #include <algorithm>
+#include <functional>
+#include <memory>
+#include <limits>
+#include <new>
+#include <cstdint>
+#include <cstddef>
+#include <type_traits>
 #include <assert.h>
 #include <crtdbg.h>
 
 using namespace std;
 
+#ifndef BENCHMARK
 #define DEBUG
+#endif
 
 template <typename T>
 struct Node
@@ -17,19 +29,21 @@ struct Node
     Node* next;
 
     Node(): prev(nullptr), next(nullptr) {}
-    Node(const T& Val): val(Val), prev(nullptr), next(nullptr) {}
+    template <typename... Args>
+    explicit Node(Args&&... args): val(std::forward<Args>(args)...), prev(nullptr), next(nullptr) {} //直接在节点中构造元素
 };
 
 
 // 预先声明
-template <typename T>
+template <typename T, typename Alloc>
 class List;
 
 
 template <typename T>
 class List_iterator
 {
-    friend class List<T>;
+    template <typename U, typename Alloc>
+    friend class List;
 public:
     typedef Node<T>* Ptr;
     typedef List_iterator<T> Self;
@@ -43,6 +57,8 @@ public:
     T& operator*();
     Self& operator++();
     Self operator++(int);
+    Self& operator--();
+    Self operator--(int);
     bool operator==(const Self& other) const { return cur == other.cur; }
     bool operator!=(const Self& other) const { return cur != other.cur; }
 
@@ -51,7 +67,9 @@ private:
 };
 
 
-template <typename T>
+// 节点（包括head节点）都通过分配器申请，Alloc按allocator_traits的rebind换成对Node<T>的分配器
+// 默认的std::allocator每个节点调用一次operator new，可以换成下面的PoolAllocator从连续的大块内存中切分节点
+template <typename T, typename Alloc = allocator<T> >
 class List
 {
 public:
@@ -61,13 +79,21 @@ public:
     // 最好不要让别名和原类型的一部分一样，容易出错
     typedef List_iterator<T> iterator;
     typedef const List_iterator<T> const_iterator;
+    typedef Alloc allocator_type;
 
     List() { createHead(); }
-    List(int num, T val);
+    explicit List(const Alloc& a): alloc(a) { createHead(); }
+    List(int num, const T& val, const Alloc& a = Alloc());
     List(const List& other);
+    // 移动时直接接管other的head节点，other换上一个新的空head节点，不逐个移动元素
+    // 新的head节点需要申请内存，可能抛出异常，所以不能声明noexcept（和MSVC的std::list一样），Vec<List<T>>扩容时会拷贝
+    List(List&& other);
     List& operator=(const List& other);
+    List& operator=(List&& other);
     ~List();
 
+    allocator_type get_allocator() const { return allocator_type(alloc); }
+
     // 因为是循环链表，所以需要标记链表头，head节点便是这样的节点
     // 因此head节点本身不含有效val，head节点的下一个节点才是真正的头节点，而head节点本身来表示end节点也符合前闭后开原则
     iterator begin() {return iterator(head->next);}
@@ -75,16 +101,62 @@ public:
     iterator end() {return iterator(head);}
     const_iterator end() const {return iterator(head);}
     bool empty() {return head->next == head;}
+    size_t size() const { return count; }
 
-    void push_back(T val);
+    void push_back(const T& val) { emplace_back(val); }
+    void push_back(T&& val) { emplace_back(std::move(val)); }
+    void push_front(const T& val) { emplace_front(val); }
+    void push_front(T&& val) { emplace_front(std::move(val)); }
+    template <typename... Args>
+    void emplace_back(Args&&... args) { emplace(end(), std::forward<Args>(args)...); }
+    template <typename... Args>
+    void emplace_front(Args&&... args) { emplace(begin(), std::forward<Args>(args)...); }
     void pop_back();
-    iterator insert(iterator pos, T val);
+    void pop_front();
+    iterator insert(iterator pos, const T& val) { return emplace(pos, val); }
+    iterator insert(iterator pos, T&& val) { return emplace(pos, std::move(val)); }
+    template <typename... Args>
+    iterator emplace(iterator pos, Args&&... args);
     iterator erase(iterator pos);
     void clear();
+    void swap(List& other) noexcept;
+
+    // 以下操作只修改节点的指针，不分配内存，也不拷贝或移动元素，指向被移动元素的迭代器仍然有效
+    // 在两个链表之间移动节点时，两者的分配器必须相等，否则节点无法由另一个链表释放
+    void splice(iterator pos, List& other);
+    void splice(iterator pos, List& other, iterator it);
+    void splice(iterator pos, List& other, iterator first, iterator last); //other不是本链表时需要数出区间长度，O(n)
+    void merge(List& other) { merge(other, less<T>()); }
+    template <typename Compare>
+    void merge(List& other, Compare comp);
+    void sort() { sort(less<T>()); }
+    template <typename Compare>
+    void sort(Compare comp);
+    size_t unique() { return unique(equal_to<T>()); }
+    template <typename BinaryPredicate>
+    size_t unique(BinaryPredicate pred);
+    template <typename Predicate>
+    size_t remove_if(Predicate pred);
 private:
+    typedef typename allocator_traits<Alloc>::template rebind_alloc<Node> NodeAlloc;
+    typedef allocator_traits<NodeAlloc> node_traits;
+
     void createHead();
+    template <typename... Args>
+    Ptr createNode(Args&&... args);
+    void destroyNode(Ptr p);
+    // 按分配器的propagate_on_container_copy_assignment分派
+    void assignAlloc(const NodeAlloc& a, true_type);
+    void assignAlloc(const NodeAlloc&, false_type) {}
+    void moveAssign(List& other, true_type);
+    void moveAssign(List& other, false_type);
+    static void transfer(Ptr pos, Ptr first, Ptr last);
+    template <typename Compare>
+    static Ptr mergeRuns(Ptr a, Ptr b, Compare& comp);
 
     Ptr head;
+    size_t count; //元素个数，size()为O(1)
+    NodeAlloc alloc;
 };
 
 
@@ -118,18 +190,34 @@ List_iterator<T> List_iterator<T>::operator++(int)
 }
 
 
-/* List公有成员函数 */
+template <typename T>
+List_iterator<T>& List_iterator<T>::operator--()
+{
+    cur = cur->prev;
+    return *this;
+}
 
 template <typename T>
-List<T>::List(int num, T val)
+List_iterator<T> List_iterator<T>::operator--(int)
+{
+    Self temp(*this);
+    cur = cur->prev;
+    return temp;
+}
+
+
+/* List公有成员函数 */
+
+template <typename T, typename Alloc>
+List<T, Alloc>::List(int num, const T& val, const Alloc& a): alloc(a)
 {
     createHead();
     for (int i = 0; i < num; i++)
-        push_back(std::move(val));
+        push_back(val);
 }
 
-template <typename T>
-List<T>::List(const List& other)
+template <typename T, typename Alloc>
+List<T, Alloc>::List(const List& other): alloc(node_traits::select_on_container_copy_construction(other.alloc))
 {
     createHead();
     iterator it = other.begin();
@@ -141,49 +229,69 @@ List<T>::List(const List& other)
     }
 }
 
-template <typename T>
-List<T>& List<T>::operator=(const List& other)
+// 分配器是拷贝而不是移动：other之后还要用它释放新的head节点；先申请好新的head节点再接管，申请失败时两个链表都不变
+template <typename T, typename Alloc>
+List<T, Alloc>::List(List&& other): alloc(other.alloc)
+{
+    Ptr fresh = createNode(); //alloc和other.alloc相等，由谁申请的节点都可以由另一个释放
+    fresh->next = fresh;
+    fresh->prev = fresh;
+    head = other.head;
+    count = other.count;
+    other.head = fresh;
+    other.count = 0;
+}
+
+// 已有的节点直接对元素赋值，只为多出来的元素申请节点，或者释放多余的节点
+template <typename T, typename Alloc>
+List<T, Alloc>& List<T, Alloc>::operator=(const List& other)
 {
     if (&other != this)
     {
-        if (begin() != end())
-            clear();
+        if (node_traits::propagate_on_container_copy_assignment::value && !(alloc == other.alloc))
+            clear(); //节点必须由新的分配器申请，旧节点不能复用
+        assignAlloc(other.alloc, typename node_traits::propagate_on_container_copy_assignment());
 
-        iterator it = other.begin();
-        iterator endIt = other.end();
-        while (it != endIt)
+        Ptr dst = head->next;
+        Ptr src = other.head->next;
+        for (; dst != head && src != other.head; dst = dst->next, src = src->next)
+            dst->val = src->val;
+
+        while (dst != head)
         {
-            push_back(*it);
-            it++;
+            Ptr next = dst->next;
+            erase(iterator(dst));
+            dst = next;
         }
+        for (; src != other.head; src = src->next)
+            emplace_back(src->val);
     }
 
     return *this;
 }
 
-template <typename T>
-List<T>::~List()
+template <typename T, typename Alloc>
+List<T, Alloc>& List<T, Alloc>::operator=(List&& other)
+{
+    if (&other != this)
+        moveAssign(other, typename node_traits::propagate_on_container_move_assignment());
+
+    return *this;
+}
+
+template <typename T, typename Alloc>
+List<T, Alloc>::~List()
 {
     if (begin() != end())
         clear();
 
-    delete head;
+    destroyNode(head);
     head = nullptr;
 }
 
-template <typename T>
-void List<T>::push_back(T val)
-{
-    Ptr tail = head->prev;
-    Ptr newNode = new Node(std::move(val));
-    newNode->prev = tail;
-    newNode->next = head;
-    tail->next = newNode;
-    head->prev = newNode;
-}
 
-template <typename T>
-void List<T>::pop_back()
+template <typename T, typename Alloc>
+void List<T, Alloc>::pop_back()
 {
     if (empty())
         return;
@@ -192,26 +300,38 @@ void List<T>::pop_back()
     Ptr prevTail = tail->prev;
     prevTail->next = head;
     head->prev = prevTail;
-    delete tail;
+    destroyNode(tail);
     tail = nullptr;
+    --count;
 }
 
-template <typename T>
-typename List<T>::iterator List<T>::insert(iterator pos, T val)
+template <typename T, typename Alloc>
+void List<T, Alloc>::pop_front()
+{
+    if (empty())
+        return;
+
+    erase(begin());
+}
+
+template <typename T, typename Alloc>
+template <typename... Args>
+typename List<T, Alloc>::iterator List<T, Alloc>::emplace(iterator pos, Args&&... args)
 {
-    Ptr newNode = new Node(std::move(val));
+    Ptr newNode = createNode(std::forward<Args>(args)...);
     Ptr curNode = pos.cur;
     Ptr prevNode = curNode->prev;
     prevNode->next = newNode;
     newNode->prev = prevNode;
     newNode->next = curNode;
     curNode->prev = newNode;
+    ++count;
 
     return iterator(newNode);
 }
 
-template <typename T>
-typename List<T>::iterator List<T>::erase(iterator pos)
+template <typename T, typename Alloc>
+typename List<T, Alloc>::iterator List<T, Alloc>::erase(iterator pos)
 {
     if (empty())
         return iterator();
@@ -221,14 +341,15 @@ typename List<T>::iterator List<T>::erase(iterator pos)
     Ptr nextNode = curNode->next;
     prevNode->next = nextNode;
     nextNode->prev = prevNode;
-    delete curNode;
+    destroyNode(curNode);
     curNode = nullptr;
+    --count;
 
     return iterator(nextNode);
 }
 
-template <typename T>
-void List<T>::clear()
+template <typename T, typename Alloc>
+void List<T, Alloc>::clear()
 {
     iterator it = begin();
     iterator endIt = end();
@@ -236,46 +357,1725 @@ void List<T>::clear()
     {
         Ptr temp = it.cur;
         it++;
-        delete temp;
+        destroyNode(temp);
         temp = nullptr;
     }
 
     head->next = head;
     head->prev = head;
+    count = 0;
+}
+
+// 交换head节点和分配器即可，所有迭代器仍然有效，但指向的是另一个链表
+template <typename T, typename Alloc>
+void List<T, Alloc>::swap(List& other) noexcept
+{
+    std::swap(head, other.head);
+    std::swap(count, other.count);
+    if (node_traits::propagate_on_container_swap::value)
+        std::swap(alloc, other.alloc);
+}
+
+template <typename T, typename Alloc>
+void List<T, Alloc>::splice(iterator pos, List& other)
+{
+    assert(alloc == other.alloc);
+    if (&other == this || other.count == 0)
+        return;
+
+    transfer(pos.cur, other.head->next, other.head);
+    count += other.count;
+    other.count = 0;
+}
+
+template <typename T, typename Alloc>
+void List<T, Alloc>::splice(iterator pos, List& other, iterator it)
+{
+    assert(alloc == other.alloc);
+    Ptr node = it.cur;
+    if (pos.cur == node || pos.cur == node->next)
+        return;
+
+    transfer(pos.cur, node, node->next);
+    ++count;
+    --other.count;
+}
+
+template <typename T, typename Alloc>
+void List<T, Alloc>::splice(iterator pos, List& other, iterator first, iterator last)
+{
+    assert(alloc == other.alloc);
+    if (first == last)
+        return;
+
+    if (&other != this)
+    {
+        size_t n = 0;
+        for (Ptr p = first.cur; p != last.cur; p = p->next)
+            ++n;
+        count += n;
+        other.count -= n;
+    }
+    transfer(pos.cur, first.cur, last.cur);
+}
+
+// 两个链表都已按comp排好序，把other的节点逐个链入本链表的合适位置
+// 相等的元素中本链表原有的排在前面，因此是稳定的
+template <typename T, typename Alloc>
+template <typename Compare>
+void List<T, Alloc>::merge(List& other, Compare comp)
+{
+    assert(alloc == other.alloc);
+    if (&other == this)
+        return;
+
+    Ptr a = head->next;
+    Ptr b = other.head->next;
+    while (a != head && b != other.head)
+    {
+        if (comp(b->val, a->val))
+        {
+            Ptr next = b->next;
+            transfer(a, b, next);
+            b = next;
+        }
+        else
+            a = a->next;
+    }
+    if (b != other.head)
+        transfer(head, b, other.head);
+
+    count += other.count;
+    other.count = 0;
+}
+
+// 自底向上的归并排序：先断开成以nullptr结尾的单链表，只用next指针归并，最后一次性恢复prev指针
+// bins[i]是一段长度为2^i的有序链表，新节点像二进制加法的进位一样逐级与之归并
+// 下标小的bins中的节点总是来自链表的后部，归并时把靠前的一段放在第一个参数，保证稳定
+template <typename T, typename Alloc>
+template <typename Compare>
+void List<T, Alloc>::sort(Compare comp)
+{
+    if (count < 2)
+        return;
+
+    Ptr bins[64] = {};
+    int fill = 0;
+    head->prev->next = nullptr;
+    Ptr rest = head->next;
+    while (rest != nullptr)
+    {
+        Ptr carry = rest;
+        rest = rest->next;
+        carry->next = nullptr;
+
+        int i = 0;
+        for (; i < fill && bins[i] != nullptr; ++i)
+        {
+            carry = mergeRuns(bins[i], carry, comp);
+            bins[i] = nullptr;
+        }
+        bins[i] = carry;
+        if (i == fill)
+            ++fill;
+    }
+
+    Ptr sorted = nullptr;
+    for (int i = 0; i < fill; ++i)
+    {
+        if (bins[i] != nullptr)
+            sorted = sorted == nullptr ? bins[i] : mergeRuns(bins[i], sorted, comp);
+    }
+
+    Ptr prev = head;
+    for (Ptr p = sorted; p != nullptr; p = p->next)
+    {
+        prev->next = p;
+        p->prev = prev;
+        prev = p;
+    }
+    prev->next = head;
+    head->prev = prev;
+}
+
+// 删除相邻的重复元素，只保留每组的第一个，返回删除的个数
+template <typename T, typename Alloc>
+template <typename BinaryPredicate>
+size_t List<T, Alloc>::unique(BinaryPredicate pred)
+{
+    size_t removed = 0;
+    Ptr p = head->next;
+    while (p != head && p->next != head)
+    {
+        if (pred(p->val, p->next->val))
+        {
+            erase(iterator(p->next));
+            ++removed;
+        }
+        else
+            p = p->next;
+    }
+
+    return removed;
+}
+
+template <typename T, typename Alloc>
+template <typename Predicate>
+size_t List<T, Alloc>::remove_if(Predicate pred)
+{
+    size_t removed = 0;
+    Ptr p = head->next;
+    while (p != head)
+    {
+        Ptr next = p->next;
+        if (pred(p->val))
+        {
+            erase(iterator(p));
+            ++removed;
+        }
+        p = next;
+    }
+
+    return removed;
 }
 
 /* List私有成员函数 */
 
-template <typename T>
-void List<T>::createHead()
+template <typename T, typename Alloc>
+void List<T, Alloc>::createHead()
 {
-    head = new Node;
+    head = createNode();
     head->next = head;
     head->prev = head;
+    count = 0;
 }
 
+template <typename T, typename Alloc>
+template <typename... Args>
+typename List<T, Alloc>::Ptr List<T, Alloc>::createNode(Args&&... args)
+{
+    Ptr p = node_traits::allocate(alloc, 1);
+    try
+    {
+        node_traits::construct(alloc, p, std::forward<Args>(args)...);
+    }
+    catch (...)
+    {
+        node_traits::deallocate(alloc, p, 1);
+        throw;
+    }
+
+    return p;
+}
 
+template <typename T, typename Alloc>
+void List<T, Alloc>::destroyNode(Ptr p)
+{
+    node_traits::destroy(alloc, p);
+    node_traits::deallocate(alloc, p, 1);
+}
 
-/* 测试代码 */
+// 分配器随之转移，直接交换head节点和分配器：本链表原来的head节点交给other，由申请它的分配器随other一起释放
+template <typename T, typename Alloc>
+void List<T, Alloc>::moveAssign(List& other, true_type)
+{
+    clear();
+    std::swap(head, other.head);
+    std::swap(count, other.count);
+    std::swap(alloc, other.alloc);
+}
+
+// 分配器不转移时，只有两个分配器相等才能接管other的节点，否则逐个移动元素，并尽量复用已有的节点
+template <typename T, typename Alloc>
+void List<T, Alloc>::moveAssign(List& other, false_type)
+{
+    if (alloc == other.alloc)
+    {
+        clear();
+        std::swap(head, other.head);
+        std::swap(count, other.count);
+        return;
+    }
 
-#ifdef DEBUG
+    Ptr dst = head->next;
+    Ptr src = other.head->next;
+    for (; dst != head && src != other.head; dst = dst->next, src = src->next)
+        dst->val = std::move(src->val);
 
-int main(int argc, char* argv[])
+    while (dst != head)
+    {
+        Ptr next = dst->next;
+        erase(iterator(dst));
+        dst = next;
+    }
+    for (; src != other.head; src = src->next)
+        emplace_back(std::move(src->val));
+    other.clear();
+}
+
+// 把[first, last)从所在的链表中摘下，链入pos之前，first和last可以属于同一个链表
+template <typename T, typename Alloc>
+void List<T, Alloc>::transfer(Ptr pos, Ptr first, Ptr last)
 {
-    List<int> a;
-    List<int> b(3, 5);
-    List<int> c(b);
-    List<int> d(4,6);
-    d = c;
+    Ptr tail = last->prev;
+    first->prev->next = last;
+    last->prev = first->prev;
 
-    a.push_back(9);
-    a.push_back(0);
-    a.pop_back();
-    a.insert(a.begin(), 8);
-    a.erase(++a.begin());
-    a.clear();
+    Ptr before = pos->prev;
+    before->next = first;
+    first->prev = before;
+    tail->next = pos;
+    pos->prev = tail;
+}
+
+// 合并两段以nullptr结尾的有序单链表，相等时先取a中的节点
+template <typename T, typename Alloc>
+template <typename Compare>
+typename List<T, Alloc>::Ptr List<T, Alloc>::mergeRuns(Ptr a, Ptr b, Compare& comp)
+{
+    Ptr result;
+    Ptr* tail = &result;
+    while (a != nullptr && b != nullptr)
+    {
+        if (comp(b->val, a->val))
+        {
+            *tail = b;
+            b = b->next;
+        }
+        else
+        {
+            *tail = a;
+            a = a->next;
+        }
+        tail = &(*tail)->next;
+    }
+    *tail = a != nullptr ? a : b;
 
+    return result;
 }
 
-#endif // DEBUG
+// 分配器随赋值转移时，head节点也要换成由新分配器申请的，调用前链表已经清空
+template <typename T, typename Alloc>
+void List<T, Alloc>::assignAlloc(const NodeAlloc& a, true_type)
+{
+    if (alloc == a)
+        return;
+
+    destroyNode(head);
+    alloc = a;
+    createHead();
+}
+
+
+
+/* 节点池 */
+
+// 链表的节点大小固定，而且频繁地单个申请、释放，适合用slab分配：
+// 每种大小的节点对应一个slab，从按几何级数增长的大块内存中依次切出节点，释放的节点挂到空闲链表上供下次复用
+// 相邻申请的节点在内存中也相邻，遍历时的缓存命中率比逐个operator new高
+// 和Vec.cpp中的Arena一样，NodePool不是线程安全的，析构时一次释放所有大块内存
+class NodePool
+{
+public:
+    explicit NodePool(size_t first_chunk_nodes = 64): slabs(nullptr), last(nullptr), chunks(nullptr), first_count(first_chunk_nodes) {}
+    ~NodePool();
+
+    void* allocate(size_t bytes);
+    void deallocate(void* p, size_t bytes) noexcept;
+
+private:
+    enum { MAX_CHUNK_BYTES = 1 << 20 }; //单个大块的上限，节点很多时不再继续翻倍
+
+    struct FreeNode
+    {
+        FreeNode* next;
+    };
+
+    struct Chunk
+    {
+        Chunk* next;
+    };
+
+    struct Slab
+    {
+        size_t size;
+        FreeNode* free; //释放后可以复用的节点
+        char* cur; //当前大块中尚未切分的部分
+        char* limit;
+        size_t next_count; //下一个大块容纳的节点数
+        Slab* next;
+    };
+
+    Slab* slabs;
+    Slab* last; //最近使用的slab，同一个链表反复申请时不需要查找
+    Chunk* chunks;
+    size_t first_count;
+
+    NodePool(const NodePool&);
+    NodePool& operator=(const NodePool&);
+
+    static size_t block_size(size_t bytes) { return max(bytes, sizeof(FreeNode)); }
+    Slab* find(size_t size);
+    void refill(Slab* slab);
+};
+
+
+NodePool::~NodePool()
+{
+    while (chunks != nullptr)
+    {
+        Chunk* next = chunks->next;
+        ::operator delete(chunks);
+        chunks = next;
+    }
+
+    while (slabs != nullptr)
+    {
+        Slab* next = slabs->next;
+        delete slabs;
+        slabs = next;
+    }
+}
+
+
+void* NodePool::allocate(size_t bytes)
+{
+    Slab* slab = find(block_size(bytes));
+    if (slab->free != nullptr)
+    {
+        FreeNode* node = slab->free;
+        slab->free = node->next;
+        return node;
+    }
+
+    if (slab->cur == slab->limit)
+        refill(slab);
+
+    void* p = slab->cur;
+    slab->cur += slab->size;
+    return p;
+}
+
+
+void NodePool::deallocate(void* p, size_t bytes) noexcept
+{
+    Slab* slab = find(block_size(bytes)); //申请时已经建立了对应的slab，这里不会分配内存
+    FreeNode* node = static_cast<FreeNode*>(p);
+    node->next = slab->free;
+    slab->free = node;
+}
+
+
+NodePool::Slab* NodePool::find(size_t size)
+{
+    if (last != nullptr && last->size == size)
+        return last;
+
+    Slab* slab = slabs;
+    while (slab != nullptr && slab->size != size)
+        slab = slab->next;
+
+    if (slab == nullptr)
+    {
+        slab = new Slab;
+        slab->size = size;
+        slab->free = nullptr;
+        slab->cur = slab->limit = nullptr;
+        slab->next_count = first_count;
+        slab->next = slabs;
+        slabs = slab;
+    }
+
+    last = slab;
+    return slab;
+}
+
+
+// 大块内存的开头是Chunk头部，按max_align_t对齐，之后的节点大小是其类型对齐值的整数倍，因此每个节点都是对齐的
+void NodePool::refill(Slab* slab)
+{
+    const size_t header = (sizeof(Chunk) + alignof(max_align_t) - 1) / alignof(max_align_t) * alignof(max_align_t);
+    size_t count = slab->next_count;
+    Chunk* chunk = static_cast<Chunk*>(::operator new(header + count * slab->size));
+    chunk->next = chunks;
+    chunks = chunk;
+
+    slab->cur = reinterpret_cast<char*>(chunk) + header;
+    slab->limit = slab->cur + count * slab->size;
+    if (count * slab->size < MAX_CHUNK_BYTES)
+        slab->next_count = count * 2;
+}
+
+
+// 从NodePool中申请节点的分配器，只保存一个指向NodePool的指针
+// 和Vec.cpp中的ArenaAllocator一样，容器拷贝、赋值、交换时分配器都不随之转移
+// 单个对象从节点池中分配；一次申请多个对象的情况链表用不到，直接转给operator new
+template <typename T>
+class PoolAllocator
+{
+    static_assert(alignof(T) <= alignof(max_align_t), "over-aligned types are not supported by NodePool");
+
+public:
+    typedef T value_type;
+    typedef false_type propagate_on_container_copy_assignment;
+    typedef false_type propagate_on_container_move_assignment;
+    typedef false_type propagate_on_container_swap;
+
+    explicit PoolAllocator(NodePool& p) noexcept : pool(&p) {}
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>& other) noexcept : pool(other.pool) {}
+
+    T* allocate(size_t n)
+    {
+        if (n == 1)
+            return static_cast<T*>(pool->allocate(sizeof(T)));
+        if (n > numeric_limits<size_t>::max() / sizeof(T))
+            throw bad_alloc();
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, size_t n) noexcept
+    {
+        if (n == 1)
+            pool->deallocate(p, sizeof(T));
+        else
+            ::operator delete(p);
+    }
+
+    template <typename U>
+    bool operator==(const PoolAllocator<U>& other) const { return pool == other.pool; }
+    template <typename U>
+    bool operator!=(const PoolAllocator<U>& other) const { return pool != other.pool; }
+
+private:
+    template <typename U>
+    friend class PoolAllocator;
+
+    NodePool* pool;
+};
+
+// trivially_relocatable在Vec.cpp中定义，这里只需要声明；PoolAllocator只保存一个指向节点池的指针，用它的Vec可以整块搬运
+template <typename T>
+struct trivially_relocatable;
+
+template <typename T>
+struct trivially_relocatable<PoolAllocator<T> > : true_type {};
+
+
+
+/* 展开链表 */
+
+// 每个节点存放最多ChunkSize个元素，元素在节点内连续存放，遍历时每ChunkSize个元素才跟随一次指针
+// 插入时节点已满则对半分裂；删除后节点不足四分之一满时，若能放下就把后继节点合并进来
+// 接口和List一致，但插入、删除会在节点内移动元素，指向同一节点中其他元素的迭代器会失效，应使用返回的迭代器
+
+// 节点之间的链接，head节点只有这一部分，元素个数为0
+struct UnrolledLink
+{
+    UnrolledLink* prev;
+    UnrolledLink* next;
+    size_t count;
+
+    UnrolledLink(): prev(nullptr), next(nullptr), count(0) {}
+};
+
+// 元素存放在未初始化的内存中，只有[0, count)之间的元素是构造过的，T不需要默认构造函数
+template <typename T, size_t ChunkSize>
+struct UnrolledNode : UnrolledLink
+{
+    typename aligned_storage<sizeof(T), alignof(T)>::type slots[ChunkSize];
+
+    T* at(size_t i) { return reinterpret_cast<T*>(&slots[i]); }
+};
+
+
+template <typename T, size_t ChunkSize>
+class UnrolledList;
+
+
+// 由节点和节点内的下标组成，end()是(head, 0)
+template <typename T, size_t ChunkSize>
+class UnrolledList_iterator
+{
+    friend class UnrolledList<T, ChunkSize>;
+public:
+    typedef UnrolledNode<T, ChunkSize> Chunk;
+    typedef UnrolledList_iterator<T, ChunkSize> Self;
+
+    UnrolledList_iterator(): cur(nullptr), idx(0) {}
+    UnrolledList_iterator(UnrolledLink* x, size_t i): cur(x), idx(i) {}
+
+    T* operator->() { return static_cast<Chunk*>(cur)->at(idx); }
+    T& operator*() { return *static_cast<Chunk*>(cur)->at(idx); }
+    Self& operator++();
+    Self operator++(int) { Self temp(*this); ++*this; return temp; }
+    Self& operator--();
+    Self operator--(int) { Self temp(*this); --*this; return temp; }
+    bool operator==(const Self& other) const { return cur == other.cur && idx == other.idx; }
+    bool operator!=(const Self& other) const { return !(*this == other); }
+
+private:
+    UnrolledLink* cur;
+    size_t idx;
+};
+
+
+template <typename T, size_t ChunkSize = (sizeof(T) < 64 ? 512 / sizeof(T) : 8)>
+class UnrolledList
+{
+    static_assert(ChunkSize >= 2, "a chunk must hold at least two elements");
+
+public:
+    typedef UnrolledList_iterator<T, ChunkSize> iterator;
+    typedef const UnrolledList_iterator<T, ChunkSize> const_iterator;
+
+    UnrolledList(): total(0) { createHead(); }
+    UnrolledList(const UnrolledList& other);
+    UnrolledList& operator=(const UnrolledList& other);
+    ~UnrolledList();
+
+    iterator begin() { return iterator(head->next, 0); }
+    const_iterator begin() const { return iterator(head->next, 0); }
+    iterator end() { return iterator(head, 0); }
+    const_iterator end() const { return iterator(head, 0); }
+    bool empty() const { return total == 0; }
+    size_t size() const { return total; }
+
+    void push_back(T val) { insert(end(), std::move(val)); }
+    void pop_back();
+    iterator insert(iterator pos, T val);
+    iterator erase(iterator pos);
+    void clear();
+
+private:
+    typedef UnrolledNode<T, ChunkSize> Chunk;
+
+    static Chunk* chunk(UnrolledLink* p) { return static_cast<Chunk*>(p); }
+    void createHead();
+    Chunk* linkChunk(UnrolledLink* before);
+    void unlinkChunk(UnrolledLink* node);
+    static void moveElements(Chunk* from, size_t first, size_t last, Chunk* to, size_t dest);
+
+    UnrolledLink* head;
+    size_t total;
+};
+
+
+/* UnrolledList_iterator公有成员函数 */
+
+template <typename T, size_t ChunkSize>
+UnrolledList_iterator<T, ChunkSize>& UnrolledList_iterator<T, ChunkSize>::operator++()
+{
+    if (++idx == cur->count)
+    {
+        cur = cur->next;
+        idx = 0;
+    }
+    return *this;
+}
+
+// 从end()后退时cur变为最后一个节点
+template <typename T, size_t ChunkSize>
+UnrolledList_iterator<T, ChunkSize>& UnrolledList_iterator<T, ChunkSize>::operator--()
+{
+    if (idx == 0)
+    {
+        cur = cur->prev;
+        idx = cur->count;
+    }
+    --idx;
+    return *this;
+}
+
+
+/* UnrolledList公有成员函数 */
+
+template <typename T, size_t ChunkSize>
+UnrolledList<T, ChunkSize>::UnrolledList(const UnrolledList& other): total(0)
+{
+    createHead();
+    iterator it = other.begin();
+    iterator endIt = other.end();
+    while (it != endIt)
+    {
+        push_back(*it);
+        it++;
+    }
+}
+
+template <typename T, size_t ChunkSize>
+UnrolledList<T, ChunkSize>& UnrolledList<T, ChunkSize>::operator=(const UnrolledList& other)
+{
+    if (&other != this)
+    {
+        clear();
+        iterator it = other.begin();
+        iterator endIt = other.end();
+        while (it != endIt)
+        {
+            push_back(*it);
+            it++;
+        }
+    }
+
+    return *this;
+}
+
+template <typename T, size_t ChunkSize>
+UnrolledList<T, ChunkSize>::~UnrolledList()
+{
+    clear();
+    delete head;
+    head = nullptr;
+}
+
+template <typename T, size_t ChunkSize>
+void UnrolledList<T, ChunkSize>::pop_back()
+{
+    if (empty())
+        return;
+
+    erase(--end());
+}
+
+template <typename T, size_t ChunkSize>
+typename UnrolledList<T, ChunkSize>::iterator UnrolledList<T, ChunkSize>::insert(iterator pos, T val)
+{
+    UnrolledLink* node = pos.cur;
+    size_t idx = pos.idx;
+
+    if (node == head) //在末尾插入，追加到最后一个节点
+    {
+        node = head->prev;
+        if (node == head || node->count == ChunkSize)
+            node = linkChunk(head);
+        idx = node->count;
+    }
+    else if (node->count == ChunkSize) //节点已满，后一半搬到新节点中
+    {
+        size_t half = ChunkSize / 2;
+        Chunk* right = linkChunk(node->next);
+        moveElements(chunk(node), half, ChunkSize, right, 0);
+        right->count = ChunkSize - half;
+        node->count = half;
+        if (idx > half)
+        {
+            node = right;
+            idx -= half;
+        }
+    }
+
+    // 节点内有空位，把[idx, count)后移一位
+    Chunk* c = chunk(node);
+    if (idx == c->count)
+        ::new (static_cast<void*>(c->at(idx))) T(std::move(val));
+    else
+    {
+        ::new (static_cast<void*>(c->at(c->count))) T(std::move(*c->at(c->count - 1)));
+        std::move_backward(c->at(idx), c->at(c->count - 1), c->at(c->count));
+        *c->at(idx) = std::move(val);
+    }
+    ++c->count;
+    ++total;
+
+    return iterator(node, idx);
+}
+
+template <typename T, size_t ChunkSize>
+typename UnrolledList<T, ChunkSize>::iterator UnrolledList<T, ChunkSize>::erase(iterator pos)
+{
+    if (empty())
+        return iterator();
+
+    UnrolledLink* node = pos.cur;
+    size_t idx = pos.idx;
+    Chunk* c = chunk(node);
+    std::move(c->at(idx + 1), c->at(c->count), c->at(idx));
+    c->at(c->count - 1)->~T();
+    --c->count;
+    --total;
+
+    if (c->count == 0)
+    {
+        UnrolledLink* next = node->next;
+        unlinkChunk(node);
+        return iterator(next, 0);
+    }
+
+    UnrolledLink* next = node->next;
+    if (c->count < ChunkSize / 4 && next != head && c->count + next->count <= ChunkSize)
+    {
+        moveElements(chunk(next), 0, next->count, c, c->count);
+        c->count += next->count;
+        unlinkChunk(next);
+    }
+
+    if (idx == c->count)
+        return iterator(node->next, 0);
+    return iterator(node, idx);
+}
+
+template <typename T, size_t ChunkSize>
+void UnrolledList<T, ChunkSize>::clear()
+{
+    UnrolledLink* node = head->next;
+    while (node != head)
+    {
+        UnrolledLink* next = node->next;
+        Chunk* c = chunk(node);
+        for (size_t i = 0; i < c->count; ++i)
+            c->at(i)->~T();
+        delete c;
+        node = next;
+    }
+
+    head->next = head;
+    head->prev = head;
+    total = 0;
+}
+
+
+/* UnrolledList私有成员函数 */
+
+template <typename T, size_t ChunkSize>
+void UnrolledList<T, ChunkSize>::createHead()
+{
+    head = new UnrolledLink;
+    head->next = head;
+    head->prev = head;
+}
+
+// 在before之前链入一个空节点
+template <typename T, size_t ChunkSize>
+typename UnrolledList<T, ChunkSize>::Chunk* UnrolledList<T, ChunkSize>::linkChunk(UnrolledLink* before)
+{
+    Chunk* c = new Chunk;
+    c->prev = before->prev;
+    c->next = before;
+    before->prev->next = c;
+    before->prev = c;
+    return c;
+}
+
+// 调用前节点中的元素已经析构或者搬走
+template <typename T, size_t ChunkSize>
+void UnrolledList<T, ChunkSize>::unlinkChunk(UnrolledLink* node)
+{
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    delete chunk(node);
+}
+
+// 把from中[first, last)的元素移动构造到to的dest开始处，并析构原来的元素，不修改两个节点的count
+template <typename T, size_t ChunkSize>
+void UnrolledList<T, ChunkSize>::moveElements(Chunk* from, size_t first, size_t last, Chunk* to, size_t dest)
+{
+    for (size_t i = first; i < last; ++i, ++dest)
+    {
+        ::new (static_cast<void*>(to->at(dest))) T(std::move(*from->at(i)));
+        from->at(i)->~T();
+    }
+}
+
+
+
+/* 侵入式链表 */
+
+// 元素自己带着链表的挂钩（ListHook成员），链表只是把这些挂钩串起来：插入时不申请节点，元素的内存由使用者管理
+// 知道元素就能在O(1)时间内把它从链表中摘下，不需要先查找迭代器，适合LRU、定时器这类元素已经存放在别处的场景
+// 一个元素可以有多个挂钩，同时挂在多个链表上；元素在链表中时不能移动或者析构
+// 用法：struct Entry { int key; ListHook lru; }; IntrusiveList<Entry, &Entry::lru> list;
+
+struct ListHook
+{
+    ListHook* prev;
+    ListHook* next;
+
+    ListHook(): prev(nullptr), next(nullptr) {}
+    ListHook(const ListHook&): prev(nullptr), next(nullptr) {} //拷贝元素不拷贝它所在的位置，副本不在任何链表中
+    ListHook& operator=(const ListHook&) { return *this; }
+    ~ListHook() { assert(prev == nullptr); } //元素析构前必须先从链表中摘下
+
+    bool is_linked() const { return prev != nullptr; }
+};
+
+
+template <typename T, ListHook T::*Hook>
+class IntrusiveList;
+
+
+template <typename T, ListHook T::*Hook>
+class IntrusiveList_iterator
+{
+    friend class IntrusiveList<T, Hook>;
+public:
+    typedef IntrusiveList_iterator<T, Hook> Self;
+
+    IntrusiveList_iterator(): cur(nullptr) {}
+    explicit IntrusiveList_iterator(ListHook* x): cur(x) {}
+
+    T* operator->() const { return IntrusiveList<T, Hook>::owner(cur); }
+    T& operator*() const { return *IntrusiveList<T, Hook>::owner(cur); }
+    Self& operator++() { cur = cur->next; return *this; }
+    Self operator++(int) { Self temp(*this); cur = cur->next; return temp; }
+    Self& operator--() { cur = cur->prev; return *this; }
+    Self operator--(int) { Self temp(*this); cur = cur->prev; return temp; }
+    bool operator==(const Self& other) const { return cur == other.cur; }
+    bool operator!=(const Self& other) const { return cur != other.cur; }
+
+private:
+    ListHook* cur;
+};
+
+
+// head是链表对象内的挂钩，和List::createHead一样首尾相连，空链表时指向自己
+// 链表不拥有元素：clear和析构只是摘下所有元素，不会析构它们
+template <typename T, ListHook T::*Hook>
+class IntrusiveList
+{
+    friend class IntrusiveList_iterator<T, Hook>;
+public:
+    typedef IntrusiveList_iterator<T, Hook> iterator;
+    typedef const IntrusiveList_iterator<T, Hook> const_iterator;
+
+    IntrusiveList(): count(0) { head.prev = head.next = &head; }
+    IntrusiveList(const IntrusiveList&) = delete; //一个挂钩只能在一个链表中
+    IntrusiveList& operator=(const IntrusiveList&) = delete;
+    IntrusiveList(IntrusiveList&& other);
+    IntrusiveList& operator=(IntrusiveList&& other);
+    ~IntrusiveList() { clear(); head.prev = head.next = nullptr; }
+
+    iterator begin() { return iterator(head.next); }
+    const_iterator begin() const { return iterator(head.next); }
+    iterator end() { return iterator(&head); }
+    const_iterator end() const { return iterator(const_cast<ListHook*>(&head)); }
+    bool empty() const { return count == 0; }
+    size_t size() const { return count; }
+    T& front() { return *owner(head.next); }
+    T& back() { return *owner(head.prev); }
+
+    void push_back(T& elem) { insert(end(), elem); }
+    void push_front(T& elem) { insert(begin(), elem); }
+    void pop_back();
+    void pop_front();
+    iterator insert(iterator pos, T& elem);
+    iterator erase(iterator pos);
+    void erase(T& elem) { erase(iterator_to(elem)); } //不需要查找，O(1)
+    void clear();
+    void swap(IntrusiveList& other);
+
+    static iterator iterator_to(T& elem) { return iterator(&(elem.*Hook)); } //elem必须在某个链表中
+
+private:
+    static T* owner(ListHook* h);
+    void takeOver(IntrusiveList& other);
+
+    ListHook head;
+    size_t count;
+};
+
+
+/* IntrusiveList公有成员函数 */
+
+template <typename T, ListHook T::*Hook>
+IntrusiveList<T, Hook>::IntrusiveList(IntrusiveList&& other): count(0)
+{
+    head.prev = head.next = &head;
+    takeOver(other);
+}
+
+template <typename T, ListHook T::*Hook>
+IntrusiveList<T, Hook>& IntrusiveList<T, Hook>::operator=(IntrusiveList&& other)
+{
+    if (&other != this)
+    {
+        clear();
+        takeOver(other);
+    }
+
+    return *this;
+}
+
+template <typename T, ListHook T::*Hook>
+void IntrusiveList<T, Hook>::pop_back()
+{
+    if (empty())
+        return;
+
+    erase(iterator(head.prev));
+}
+
+template <typename T, ListHook T::*Hook>
+void IntrusiveList<T, Hook>::pop_front()
+{
+    if (empty())
+        return;
+
+    erase(iterator(head.next));
+}
+
+template <typename T, ListHook T::*Hook>
+typename IntrusiveList<T, Hook>::iterator IntrusiveList<T, Hook>::insert(iterator pos, T& elem)
+{
+    ListHook* h = &(elem.*Hook);
+    assert(!h->is_linked()); //同一个挂钩不能同时在两个位置
+    ListHook* next = pos.cur;
+    h->prev = next->prev;
+    h->next = next;
+    next->prev->next = h;
+    next->prev = h;
+    ++count;
+    return iterator(h);
+}
+
+template <typename T, ListHook T::*Hook>
+typename IntrusiveList<T, Hook>::iterator IntrusiveList<T, Hook>::erase(iterator pos)
+{
+    ListHook* h = pos.cur;
+    assert(h != &head && h->is_linked());
+    ListHook* next = h->next;
+    h->prev->next = next;
+    next->prev = h->prev;
+    h->prev = h->next = nullptr;
+    --count;
+    return iterator(next);
+}
+
+// 必须逐个清空挂钩，元素才能知道自己已经不在链表中
+template <typename T, ListHook T::*Hook>
+void IntrusiveList<T, Hook>::clear()
+{
+    ListHook* p = head.next;
+    while (p != &head)
+    {
+        ListHook* next = p->next;
+        p->prev = p->next = nullptr;
+        p = next;
+    }
+    head.prev = head.next = &head;
+    count = 0;
+}
+
+template <typename T, ListHook T::*Hook>
+void IntrusiveList<T, Hook>::swap(IntrusiveList& other)
+{
+    IntrusiveList temp(std::move(other));
+    other.takeOver(*this);
+    takeOver(temp);
+}
+
+
+/* IntrusiveList私有成员函数 */
+
+// 由挂钩的地址减去它在T中的偏移得到元素的地址，偏移在一块未构造的T大小的内存上计算，编译器会折叠为常量
+template <typename T, ListHook T::*Hook>
+T* IntrusiveList<T, Hook>::owner(ListHook* h)
+{
+    typename aligned_storage<sizeof(T), alignof(T)>::type storage;
+    T* probe = reinterpret_cast<T*>(&storage);
+    size_t offset = reinterpret_cast<char*>(&(probe->*Hook)) - reinterpret_cast<char*>(probe);
+    return reinterpret_cast<T*>(reinterpret_cast<char*>(h) - offset);
+}
+
+// head在链表对象内部，移动时首尾元素指向head的指针必须改为指向新的head；调用前本链表为空
+template <typename T, ListHook T::*Hook>
+void IntrusiveList<T, Hook>::takeOver(IntrusiveList& other)
+{
+    if (other.empty())
+        return;
+
+    head.next = other.head.next;
+    head.prev = other.head.prev;
+    head.next->prev = &head;
+    head.prev->next = &head;
+    count = other.count;
+    other.head.prev = other.head.next = &other.head;
+    other.count = 0;
+}
+
+
+
+/* 测试代码 */
+
+// 被其他文件include时，定义NO_MAIN来跳过这里的测试代码和性能测试代码
+#if defined(DEBUG) && !defined(NO_MAIN)
+
+#include <string>
+#include <map>
+
+// 带编号的分配器，随移动赋值转移；记录每块内存由哪个编号申请，释放时检查是同一个编号
+template <typename T>
+class TaggedAlloc
+{
+public:
+    typedef T value_type;
+    typedef true_type propagate_on_container_move_assignment;
+
+    explicit TaggedAlloc(int t) noexcept : tag(t) {}
+    template <typename U>
+    TaggedAlloc(const TaggedAlloc<U>& other) noexcept : tag(other.tag) {}
+
+    T* allocate(size_t n)
+    {
+        T* p = static_cast<T*>(::operator new(n * sizeof(T)));
+        owners()[p] = tag;
+        return p;
+    }
+
+    void deallocate(T* p, size_t n) noexcept
+    {
+        assert(owners()[p] == tag);
+        owners().erase(p);
+        ::operator delete(p);
+    }
+
+    template <typename U>
+    bool operator==(const TaggedAlloc<U>& other) const { return tag == other.tag; }
+    template <typename U>
+    bool operator!=(const TaggedAlloc<U>& other) const { return tag != other.tag; }
+
+    static map<void*, int>& owners()
+    {
+        static map<void*, int> m;
+        return m;
+    }
+
+    int tag;
+};
+
+int main(int argc, char* argv[])
+{
+    List<int> a;
+    List<int> b(3, 5);
+    List<int> c(b);
+    List<int> d(4,6);
+    d = c;
+
+    a.push_back(9);
+    a.push_back(0);
+    a.pop_back();
+    a.insert(a.begin(), 8);
+    a.erase(++a.begin());
+    a.clear();
+
+    {
+        NodePool pool(4);
+        typedef List<int, PoolAllocator<int> > PoolList;
+        PoolList e((PoolAllocator<int>(pool)));
+        for (int i = 0; i < 100; ++i)
+            e.push_back(i);
+        int expected = 0;
+        for (PoolList::iterator it = e.begin(); it != e.end(); ++it)
+            assert(*it == expected++);
+        assert(expected == 100);
+
+        // 释放的节点被下一次申请复用
+        PoolList::iterator second = ++e.begin();
+        int* freed = &*second;
+        e.erase(second);
+        assert(&*e.insert(e.begin(), -1) == freed);
+
+        PoolList f(e); //拷贝时沿用同一个节点池
+        assert(f.get_allocator() == e.get_allocator() && *f.begin() == -1);
+        PoolList g(3, 7, PoolAllocator<int>(pool));
+        g = f;
+        assert(*g.begin() == -1);
+
+        List<string, PoolAllocator<string> > h((PoolAllocator<string>(pool))); //不同大小的节点使用各自的slab
+        h.push_back(string(40, 'x'));
+        h.push_back("short");
+        assert(*h.begin() == string(40, 'x') && *++h.begin() == "short");
+        assert(*--h.end() == "short");
+    }
+
+    {
+        // 与List对照：按固定规律插入、删除之后，两者的内容应当完全相同
+        UnrolledList<int, 4> u;
+        List<int> l;
+        for (int i = 0; i < 50; ++i)
+        {
+            u.push_back(i);
+            l.push_back(i);
+        }
+        UnrolledList<int, 4>::iterator ui = u.begin();
+        List<int>::iterator li = l.begin();
+        for (int step = 0; step < 200; ++step)
+        {
+            if (ui == u.end())
+            {
+                ui = u.begin();
+                li = l.begin();
+            }
+            if (step % 3 == 0)
+            {
+                ui = u.erase(ui);
+                li = l.erase(li);
+            }
+            else if (step % 3 == 1)
+            {
+                ui = u.insert(ui, 1000 + step);
+                li = l.insert(li, 1000 + step);
+                ++ui;
+                ++li;
+            }
+            else
+            {
+                ++ui;
+                ++li;
+            }
+        }
+        size_t n = 0;
+        li = l.begin();
+        for (ui = u.begin(); ui != u.end(); ++ui, ++li, ++n)
+            assert(*ui == *li);
+        assert(li == l.end() && n == u.size());
+
+        UnrolledList<int, 4>::iterator back = u.end();
+        --back;
+        assert(*back == *--l.end());
+
+        UnrolledList<string, 3> s;
+        s.push_back("b");
+        s.insert(s.begin(), "a");
+        s.push_back("c");
+        s.push_back("d"); //第二个节点
+        s.insert(++s.begin(), "ab"); //第一个节点已满，分裂
+        UnrolledList<string, 3> t(s);
+        const char* expected[] = { "a", "ab", "b", "c", "d" };
+        int k = 0;
+        for (UnrolledList<string, 3>::iterator it = t.begin(); it != t.end(); ++it)
+            assert(*it == expected[k++]);
+        assert(k == 5 && t.size() == 5);
+        while (!s.empty())
+            s.pop_back();
+        assert(s.begin() == s.end());
+        t = s;
+        assert(t.empty());
+    }
+
+    {
+        List<int> x, y;
+        for (int i = 0; i < 5; ++i)
+        {
+            x.push_back(i);
+            y.push_back(10 + i);
+        }
+        assert(x.size() == 5 && y.size() == 5);
+        List<int>::iterator moved = y.begin();
+        x.splice(++x.begin(), y, moved); //单个节点，迭代器仍指向原来的元素
+        assert(*moved == 10 && x.size() == 6 && y.size() == 4 && *++x.begin() == 10);
+        x.splice(x.end(), y, ++y.begin(), y.end()); //11 12 13 14中的后三个
+        assert(x.size() == 9 && y.size() == 1 && *--x.end() == 14 && *y.begin() == 11);
+        x.splice(x.begin(), y);
+        assert(x.size() == 10 && y.empty() && y.size() == 0 && *x.begin() == 11);
+        x.splice(x.end(), x, x.begin(), ++++x.begin()); //同一链表内移动，长度不变
+        assert(x.size() == 10 && *x.begin() == 10 && *--x.end() == 0);
+
+        // 按第一个分量排序，相等时保持原来的先后顺序
+        List<pair<int, int> > z;
+        for (int i = 0; i < 1000; ++i)
+            z.push_back(make_pair((i * 7919) % 13, i));
+        pair<int, int>* first = &*z.begin(); //(0, 0)，排序后仍在最前面
+        pair<int, int>* relinked = &*++z.begin(); //(2, 1)，排序后排在所有键为0和1的元素之后
+        z.sort([](const pair<int, int>& a, const pair<int, int>& b) { return a.first < b.first; });
+        assert(z.size() == 1000);
+        List<pair<int, int> >::iterator it = z.begin(), prev = it++;
+        for (; it != z.end(); prev = it++)
+            assert(prev->first < it->first || (prev->first == it->first && prev->second < it->second));
+        size_t pos = 0;
+        for (it = z.begin(); it->second != 1; ++it)
+            ++pos;
+        assert(&*z.begin() == first && &*it == relinked && pos > 1); //同一个节点带着原来的值到了新位置：节点被重新链接，而不是拷贝元素
+        for (it = --z.end(); it != z.begin(); --it) //prev指针也已恢复
+            assert(it->first >= (--List<pair<int, int> >::iterator(it))->first);
+
+        List<int> a1, b1;
+        int av[] = { 1, 3, 3, 5, 9 }, bv[] = { 0, 3, 4, 9, 10 };
+        for (int i = 0; i < 5; ++i)
+        {
+            a1.push_back(av[i]);
+            b1.push_back(bv[i]);
+        }
+        int* three = &*++b1.begin();
+        a1.merge(b1);
+        int merged[] = { 0, 1, 3, 3, 3, 4, 5, 9, 9, 10 };
+        int k = 0;
+        for (List<int>::iterator m = a1.begin(); m != a1.end(); ++m)
+            assert(*m == merged[k++]);
+        assert(k == 10 && a1.size() == 10 && b1.empty());
+        assert(&*++++++++a1.begin() == three); //b1中的3排在a1中相等元素之后
+
+        assert(a1.unique() == 3 && a1.size() == 7);
+        assert(a1.remove_if([](int v) { return v % 2 == 0; }) == 3 && a1.size() == 4);
+        assert(*a1.begin() == 1 && *--a1.end() == 9);
+        a1.clear();
+        assert(a1.size() == 0 && a1.unique() == 0);
+        a1.sort();
+    }
+
+    {
+        // 移动构造和移动赋值只交换head节点，元素和节点都不动
+        List<int> m1;
+        for (int i = 0; i < 5; ++i)
+            m1.push_back(i);
+        int* first = &*m1.begin();
+        List<int> m2(std::move(m1));
+        assert(m1.empty() && m1.size() == 0 && m2.size() == 5 && &*m2.begin() == first);
+        m1.push_back(7); //被移动后仍然是可用的空链表
+        m1 = std::move(m2);
+        assert(m1.size() == 5 && m2.empty() && &*m1.begin() == first);
+        auto make = [](int n) { List<int> r; for (int i = 0; i < n; ++i) r.push_back(i); return r; };
+        List<int> m3 = make(100);
+        assert(m3.size() == 100 && *--m3.end() == 99);
+        m3.swap(m1);
+        assert(m3.size() == 5 && m1.size() == 100);
+
+        // 元素直接在节点中构造，只能移动的类型也可以放进链表
+        List<pair<int, string> > e1;
+        e1.emplace_back(1, "one");
+        e1.emplace_front(0, "zero");
+        e1.emplace(--e1.end(), 2, "two");
+        assert(e1.size() == 3 && e1.begin()->second == "zero" && (++e1.begin())->first == 2 && (--e1.end())->second == "one");
+        List<unique_ptr<int> > e2;
+        e2.push_back(unique_ptr<int>(new int(1)));
+        e2.emplace_back(new int(2));
+        e2.push_front(unique_ptr<int>(new int(0)));
+        e2.insert(e2.end(), unique_ptr<int>(new int(3)));
+        assert(e2.size() == 4 && **e2.begin() == 0 && **--e2.end() == 3);
+        e2.pop_front();
+        assert(e2.size() == 3 && **e2.begin() == 1);
+        List<unique_ptr<int> > e3;
+        e3 = std::move(e2);
+        assert(e3.size() == 3 && e2.empty());
+
+        string s("moved");
+        List<string> e4;
+        e4.push_back(std::move(s));
+        e4.push_front(string("front"));
+        assert(*e4.begin() == "front" && *--e4.end() == "moved");
+        e4.pop_front();
+        e4.pop_front();
+        e4.pop_front(); //空链表上pop_front什么都不做
+        assert(e4.empty());
+
+        // 拷贝赋值复用已有的节点，只为多出的元素申请节点
+        List<int> c1(3, 7), c2(5, 9), c3(1, 4);
+        int* reused = &*c1.begin();
+        c1 = c2;
+        assert(c1.size() == 5 && &*c1.begin() == reused && *c1.begin() == 9 && *--c1.end() == 9);
+        c1 = c3;
+        assert(c1.size() == 1 && &*c1.begin() == reused && *c1.begin() == 4);
+        c1 = List<int>();
+        assert(c1.empty());
+
+        // 分配器不相等且不随移动转移时，逐个移动元素，节点仍由各自的分配器申请
+        NodePool pool_a, pool_b;
+        List<int, PoolAllocator<int> > p1((PoolAllocator<int>(pool_a))), p2((PoolAllocator<int>(pool_b)));
+        for (int i = 0; i < 4; ++i)
+            p2.push_back(i);
+        p1.push_back(100);
+        int* kept = &*p1.begin();
+        p1 = std::move(p2);
+        assert(p1.size() == 4 && p2.empty() && &*p1.begin() == kept && *p1.begin() == 0 && *--p1.end() == 3);
+    }
+
+    {
+        // 分配器随移动赋值转移时，每个节点（包括head节点）仍由申请它的分配器释放
+        typedef List<int, TaggedAlloc<int> > TaggedList;
+        TaggedList t1((TaggedAlloc<int>(1))), t2((TaggedAlloc<int>(2)));
+        t1.push_back(10);
+        for (int i = 0; i < 3; ++i)
+            t2.push_back(i);
+        t1 = std::move(t2);
+        assert(t1.size() == 3 && *t1.begin() == 0 && t1.get_allocator().tag == 2);
+        assert(t2.empty() && t2.get_allocator().tag == 1);
+        t2.push_back(5);
+
+        // 移动构造后两个链表都可以继续使用，分配器相同
+        TaggedList t3(std::move(t1));
+        assert(t3.size() == 3 && t1.empty() && t1.get_allocator() == t3.get_allocator());
+        t1.push_back(7);
+        assert(*t1.begin() == 7 && *--t3.end() == 2);
+    }
+    assert(TaggedAlloc<int>::owners().empty());
+
+    {
+        // 同一个元素同时挂在两个链表上，各自独立
+        struct Entry
+        {
+            int key;
+            ListHook lru;
+            ListHook bucket;
+            Entry(int k = 0): key(k) {}
+        };
+        Entry e[6];
+        for (int i = 0; i < 6; ++i)
+            e[i].key = i;
+
+        IntrusiveList<Entry, &Entry::lru> lru;
+        IntrusiveList<Entry, &Entry::bucket> odd;
+        for (int i = 0; i < 6; ++i)
+        {
+            lru.push_front(e[i]);
+            if (i % 2)
+                odd.push_back(e[i]);
+        }
+        assert(lru.size() == 6 && odd.size() == 3 && lru.front().key == 5 && lru.back().key == 0);
+        assert(&*lru.begin() == &e[5] && (++odd.begin())->key == 3);
+
+        // 命中时从任意位置摘下再放到头部，不查找也不分配
+        lru.erase(e[2]);
+        assert(!e[2].lru.is_linked() && e[2].bucket.is_linked() == false && lru.size() == 5);
+        lru.push_front(e[2]);
+        lru.erase(e[3]);
+        lru.push_front(e[3]);
+        int order[] = { 3, 2, 5, 4, 1, 0 };
+        int k = 0;
+        for (IntrusiveList<Entry, &Entry::lru>::iterator it = lru.begin(); it != lru.end(); ++it)
+            assert(it->key == order[k++]);
+        assert(k == 6 && odd.size() == 3 && (++odd.begin())->key == 3); //另一个链表不受影响
+        for (IntrusiveList<Entry, &Entry::lru>::iterator it = --lru.end(); it != lru.begin(); --it)
+            assert(it->key == order[--k]);
+
+        IntrusiveList<Entry, &Entry::lru>::iterator it = lru.iterator_to(e[4]);
+        it = lru.erase(it);
+        assert(it->key == 1 && lru.size() == 5);
+        lru.insert(it, e[4]);
+        lru.pop_back();
+        lru.pop_front();
+        assert(lru.size() == 4 && lru.front().key == 2 && lru.back().key == 1 && !e[0].lru.is_linked() && !e[3].lru.is_linked());
+
+        // 移动后首尾元素指向新的head
+        IntrusiveList<Entry, &Entry::lru> moved(std::move(lru));
+        assert(lru.empty() && lru.begin() == lru.end() && moved.size() == 4);
+        assert(&*--moved.end() == &e[1] && &*moved.begin() == &e[2]);
+        lru.push_back(e[0]);
+        lru.swap(moved);
+        assert(lru.size() == 4 && moved.size() == 1 && moved.front().key == 0 && &*--lru.end() == &e[1]);
+        moved = std::move(lru);
+        assert(moved.size() == 4 && lru.empty() && !e[0].lru.is_linked());
+
+        Entry copy(e[1]); //副本不在任何链表中
+        assert(!copy.lru.is_linked() && e[1].lru.is_linked());
+        moved.clear();
+        odd.clear();
+        for (int i = 0; i < 6; ++i)
+            assert(!e[i].lru.is_linked() && !e[i].bucket.is_linked());
+    }
+
+    _CrtDumpMemoryLeaks();
+}
+
+#endif // DEBUG
+
+
+/* 性能测试代码 */
+
+#if defined(BENCHMARK) && !defined(NO_MAIN)
+
+#pragma push_macro("NO_MAIN")
+#define NO_MAIN
+#include "Vec.cpp"
+#pragma pop_macro("NO_MAIN")
+#include <chrono>
+#include <cstdlib>
+
+double ms_since(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+
+// 两个链表交替插入，模拟堆上同时有其他分配的情况：逐个operator new时两个链表的节点在内存中互相穿插
+// 之后反复从头部删除、在尾部插入，再完整遍历一遍
+template <typename L>
+void bench_list(const char* name, L& a, L& b, size_t n)
+{
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < n; ++i)
+    {
+        a.push_back(int(i));
+        b.push_back(int(i));
+    }
+    double push_ms = ms_since(start);
+
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < n; ++i)
+    {
+        a.erase(a.begin());
+        a.push_back(int(i));
+    }
+    double churn_ms = ms_since(start);
+
+    long long sum = 0;
+    start = chrono::steady_clock::now();
+    for (int round = 0; round < 10; ++round)
+    {
+        for (typename L::iterator it = a.begin(); it != a.end(); ++it)
+            sum += *it;
+    }
+    double scan_ms = ms_since(start);
+
+    start = chrono::steady_clock::now();
+    a.clear();
+    b.clear();
+    double clear_ms = ms_since(start);
+
+    cout << name << ": push " << push_ms << " ms, erase+push churn " << churn_ms << " ms, 10 traversals "
+         << scan_ms << " ms, clear " << clear_ms << " ms (" << sum << ")" << endl;
+}
+
+
+// 遍历和在中间位置反复插入：List和UnrolledList持有中间位置的迭代器，在它之前插入；Vec每次都要移动后半部分
+template <typename C>
+void bench_scan_insert(const char* name, size_t n, size_t inserts)
+{
+    C c;
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < n; ++i)
+        c.push_back(int(i));
+    double push_ms = ms_since(start);
+
+    long long sum = 0;
+    start = chrono::steady_clock::now();
+    for (int round = 0; round < 10; ++round)
+    {
+        for (typename C::iterator it = c.begin(); it != c.end(); ++it)
+            sum += *it;
+    }
+    double scan_ms = ms_since(start);
+
+    typename C::iterator mid = c.begin();
+    for (size_t i = 0; i < n / 2; ++i)
+        ++mid;
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < inserts; ++i)
+        mid = c.insert(mid, int(i));
+    double insert_ms = ms_since(start);
+
+    cout << name << ": push " << push_ms << " ms, 10 traversals " << scan_ms << " ms, "
+         << inserts << " inserts in the middle " << insert_ms << " ms (" << sum << ")" << endl;
+}
+
+
+// 原来的做法：拷贝到Vec中排序，再清空链表重新插入
+template <typename T>
+void sort_via_vec(List<T>& l)
+{
+    Vec<T> v;
+    for (typename List<T>::iterator it = l.begin(); it != l.end(); ++it)
+        v.push_back(*it);
+    stable_sort(v.begin(), v.end());
+    l.clear();
+    for (size_t i = 0; i < v.size(); ++i)
+        l.push_back(v[i]);
+}
+
+
+void bench_sort(size_t n)
+{
+    List<int> a, b;
+    srand(1);
+    for (size_t i = 0; i < n; ++i)
+    {
+        int v = rand();
+        a.push_back(v);
+        b.push_back(v);
+    }
+
+    auto start = chrono::steady_clock::now();
+    sort_via_vec(a);
+    double vec_ms = ms_since(start);
+
+    start = chrono::steady_clock::now();
+    b.sort();
+    double sort_ms = ms_since(start);
+    cout << "sort " << n << " ints: copy to Vec + stable_sort + rebuild " << vec_ms << " ms, List::sort " << sort_ms << " ms" << endl;
+
+    // 元素的拷贝代价较高时，只修改指针的优势更明显
+    {
+        List<string> sa, sb;
+        for (size_t i = 0; i < n; ++i)
+        {
+            string v = to_string(rand()) + string(32, '.');
+            sa.push_back(v);
+            sb.push_back(v);
+        }
+        start = chrono::steady_clock::now();
+        sort_via_vec(sa);
+        vec_ms = ms_since(start);
+        start = chrono::steady_clock::now();
+        sb.sort();
+        sort_ms = ms_since(start);
+        cout << "sort " << n << " strings: copy to Vec + stable_sort + rebuild " << vec_ms << " ms, List::sort " << sort_ms << " ms" << endl;
+    }
+
+    // 排好序的两半归并回来
+    List<int> c;
+    List<int>::iterator mid = b.begin();
+    for (size_t i = 0; i < n / 2; ++i)
+        ++mid;
+    start = chrono::steady_clock::now();
+    c.splice(c.end(), b, mid, b.end());
+    double range_ms = ms_since(start);
+    start = chrono::steady_clock::now();
+    b.merge(c);
+    double merge_ms = ms_since(start);
+    start = chrono::steady_clock::now();
+    c.splice(c.end(), b);
+    double all_ms = ms_since(start);
+
+    start = chrono::steady_clock::now();
+    size_t removed = c.remove_if([](int v) { return v % 3 == 0; });
+    double remove_ms = ms_since(start);
+    start = chrono::steady_clock::now();
+    removed += c.unique([](int x, int y) { return x / 1024 == y / 1024; });
+    double unique_ms = ms_since(start);
+
+    cout << "splice half " << range_ms << " ms, merge " << merge_ms << " ms, splice all " << all_ms << " ms, remove_if "
+         << remove_ms << " ms, unique " << unique_ms << " ms (" << removed << " removed, " << c.size() << " left)" << endl;
+}
+
+
+// 以前的拷贝赋值先清空再逐个push_back，这里用clear加逐个push_back模拟；按值返回的链表以前只能深拷贝
+void bench_move_copy(size_t n)
+{
+    List<int> src;
+    for (size_t i = 0; i < n; ++i)
+        src.push_back(int(i));
+
+    auto start = chrono::steady_clock::now();
+    List<int> dst(src.size(), 0);
+    for (int r = 0; r < 10; ++r)
+    {
+        dst.clear();
+        for (List<int>::iterator it = src.begin(); it != src.end(); ++it)
+            dst.push_back(*it);
+    }
+    double rebuild_ms = ms_since(start);
+
+    start = chrono::steady_clock::now();
+    for (int r = 0; r < 10; ++r)
+        dst = src;
+    double reuse_ms = ms_since(start);
+
+    start = chrono::steady_clock::now();
+    for (int r = 0; r < 10; ++r)
+    {
+        List<int> copy(src);
+        dst = copy; //旧的做法：返回值只能再拷贝一次
+    }
+    double copy_ms = ms_since(start);
+
+    start = chrono::steady_clock::now();
+    for (int r = 0; r < 10; ++r)
+    {
+        List<int> copy(src);
+        dst = std::move(copy);
+    }
+    double move_ms = ms_since(start);
+
+    cout << "copy-assign x10: clear+push_back " << rebuild_ms << " ms, reuse nodes " << reuse_ms
+         << " ms; hand back a list x10: deep copy " << copy_ms << " ms, move " << move_ms << " ms (" << dst.size() << ")" << endl;
+}
+
+
+// LRU缓存：命中时把条目移到头部。List<Entry*>在条目中保存自己的迭代器，移动时要释放旧节点、申请新节点；
+// 侵入式链表只改几个指针。最后完整遍历一遍，比较跟随指针时的缓存命中情况
+struct LruEntry
+{
+    size_t key;
+    ListHook hook;
+    List<LruEntry*>::iterator pos;
+};
+
+void bench_lru(size_t n, size_t accesses)
+{
+    Vec<LruEntry> entries;
+    entries.resize(n);
+    for (size_t i = 0; i < n; ++i)
+        entries[i].key = i;
+
+    auto start = chrono::steady_clock::now();
+    List<LruEntry*> ptrs;
+    for (size_t i = 0; i < n; ++i)
+    {
+        ptrs.push_front(&entries[i]);
+        entries[i].pos = ptrs.begin();
+    }
+    double ptr_build_ms = ms_since(start);
+
+    size_t x = 12345;
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < accesses; ++i)
+    {
+        x = x * 6364136223846793005ull + 1442695040888963407ull;
+        LruEntry& e = entries[(x >> 16) % n];
+        ptrs.erase(e.pos);
+        ptrs.push_front(&e);
+        e.pos = ptrs.begin();
+    }
+    double ptr_touch_ms = ms_since(start);
+
+    start = chrono::steady_clock::now();
+    size_t ptr_sum = 0;
+    for (List<LruEntry*>::iterator it = ptrs.begin(); it != ptrs.end(); ++it)
+        ptr_sum += (*it)->key;
+    double ptr_scan_ms = ms_since(start);
+
+    start = chrono::steady_clock::now();
+    IntrusiveList<LruEntry, &LruEntry::hook> lru;
+    for (size_t i = 0; i < n; ++i)
+        lru.push_front(entries[i]);
+    double hook_build_ms = ms_since(start);
+
+    x = 12345;
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < accesses; ++i)
+    {
+        x = x * 6364136223846793005ull + 1442695040888963407ull;
+        LruEntry& e = entries[(x >> 16) % n];
+        lru.erase(e);
+        lru.push_front(e);
+    }
+    double hook_touch_ms = ms_since(start);
+
+    start = chrono::steady_clock::now();
+    size_t hook_sum = 0;
+    for (IntrusiveList<LruEntry, &LruEntry::hook>::iterator it = lru.begin(); it != lru.end(); ++it)
+        hook_sum += it->key;
+    double hook_scan_ms = ms_since(start);
+    lru.clear();
+
+    cout << "LRU over " << n << " entries, " << accesses << " touches: List<T*> build " << ptr_build_ms << " ms, touch "
+         << ptr_touch_ms << " ms, scan " << ptr_scan_ms << " ms; IntrusiveList build " << hook_build_ms << " ms, touch "
+         << hook_touch_ms << " ms, scan " << hook_scan_ms << " ms" << (ptr_sum == hook_sum ? "" : " (mismatch)") << endl;
+}
+
+
+int main(int argc, char* argv[])
+{
+    size_t n = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000000;
+
+    {
+        List<int> a, b;
+        bench_list("std::allocator", a, b, n);
+    }
+    {
+        NodePool pool_a, pool_b; //每个链表一个节点池，节点各自连续
+        List<int, PoolAllocator<int> > a((PoolAllocator<int>(pool_a))), b((PoolAllocator<int>(pool_b)));
+        bench_list("NodePool", a, b, n);
+    }
+
+    bench_scan_insert<List<int> >("List<int>", n, 10000);
+    bench_scan_insert<UnrolledList<int> >("UnrolledList<int>", n, 10000);
+    bench_scan_insert<Vec<int> >("Vec<int>", n, 10000);
+    bench_sort(n);
+    bench_move_copy(n);
+    bench_lru(n, 4 * n);
+}
+
+#endif // BENCHMARK
+
+#endif // LIST_CPP
 
@@ -0,0 +1,369 @@
+// 只读的文件映射：把整个文件映射到进程的地址空间，按T的数组访问，接口和Vec一致（begin/end/size/operator[]）
+// 打开时不读取文件内容，也不在堆上分配内存，页面在第一次访问时才由操作系统载入，多个进程映射同一文件时共享page cache
+// 文本文件可以用MappedVec<char>映射，再用StrView(m.begin(), m.end())得到不拷贝的字符串视图
+
+#ifndef MAPPEDVEC_CPP
+#define MAPPEDVEC_CPP
+
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+#include <assert.h>
+#include <crtdbg.h>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX //windows.h默认定义的min/max宏会破坏numeric_limits<size_t>::max()和std::min/max
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+using namespace std;
+
+#ifndef BENCHMARK
+#define DEBUG
+#endif
+
+// 访问模式的提示，操作系统据此调整预读：顺序扫描时积极预读并尽早回收读过的页，随机访问时不预读
+enum MapHint { HINT_NORMAL, HINT_SEQUENTIAL, HINT_RANDOM, HINT_WILLNEED };
+
+
+template<typename T>
+class MappedVec
+{
+    static_assert(is_trivially_copyable<T>::value, "MappedVec can only view trivially copyable types");
+
+public:
+    typedef const T* iterator; //只读，iterator和const_iterator相同
+    typedef const T* const_iterator;
+    typedef size_t size_type;
+    typedef const T& const_ref;
+
+    MappedVec(): base(nullptr), count(0), bytes(0) {}
+    explicit MappedVec(const char* path, MapHint hint = HINT_NORMAL): base(nullptr), count(0), bytes(0) { open(path, hint); }
+    MappedVec(const MappedVec&) = delete;
+    MappedVec& operator=(const MappedVec&) = delete;
+    MappedVec(MappedVec&& m) noexcept : base(m.base), count(m.count), bytes(m.bytes) { m.base = nullptr; m.count = m.bytes = 0; }
+    MappedVec& operator=(MappedVec&& m) noexcept;
+    ~MappedVec() { close(); }
+
+    void open(const char* path, MapHint hint = HINT_NORMAL);
+    void close();
+    void advise(MapHint hint) const;
+    bool is_open() const { return base != nullptr; }
+
+    bool empty() const { return count == 0; }
+    size_type size() const { return count; } //文件末尾不足一个T的字节被忽略
+    const T* data() const { return base; }
+    const_iterator begin() const { return base; }
+    const_iterator end() const { return base + count; }
+    const_ref front() const { return *base; }
+    const_ref back() const { return base[count - 1]; }
+    const_ref operator[](size_type n) const { return base[n]; }
+    const_ref at(size_type n) const;
+
+private:
+    const T* base; //空文件不映射，base为nullptr
+    size_type count;
+    size_t bytes; //映射的字节数，解除映射时需要
+};
+
+
+
+/* 公有成员函数的实现 */
+
+template<typename T>
+MappedVec<T>& MappedVec<T>::operator=(MappedVec&& m) noexcept
+{
+    if (&m != this)
+    {
+        close();
+        base = m.base;
+        count = m.count;
+        bytes = m.bytes;
+        m.base = nullptr;
+        m.count = m.bytes = 0;
+    }
+
+    return *this;
+}
+
+
+// 映射建立之后就不再需要文件句柄，立即关闭，映射本身会保持文件的引用
+template<typename T>
+void MappedVec<T>::open(const char* path, MapHint hint)
+{
+    close();
+
+#ifdef _WIN32
+    DWORD flags = hint == HINT_SEQUENTIAL ? FILE_FLAG_SEQUENTIAL_SCAN : (hint == HINT_RANDOM ? FILE_FLAG_RANDOM_ACCESS : FILE_ATTRIBUTE_NORMAL);
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, flags, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        throw "cannot open file";
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size))
+    {
+        CloseHandle(file);
+        throw "cannot open file";
+    }
+    if (size.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    void* p = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (mapping)
+        CloseHandle(mapping);
+    CloseHandle(file);
+    if (p == nullptr)
+        throw "cannot map file";
+    bytes = size_t(size.QuadPart);
+#else
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+        throw "cannot open file";
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        ::close(fd);
+        throw "cannot open file";
+    }
+    if (st.st_size == 0)
+    {
+        ::close(fd);
+        return;
+    }
+
+    void* p = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED)
+        throw "cannot map file";
+    bytes = size_t(st.st_size);
+#endif
+
+    base = static_cast<const T*>(p);
+    count = bytes / sizeof(T);
+    advise(hint);
+}
+
+
+template<typename T>
+void MappedVec<T>::close()
+{
+    if (base)
+    {
+#ifdef _WIN32
+        UnmapViewOfFile(base);
+#else
+        munmap(const_cast<T*>(base), bytes);
+#endif
+    }
+
+    base = nullptr;
+    count = bytes = 0;
+}
+
+
+// 打开之后也可以随时更换提示，例如先顺序建立索引，之后再按索引随机查找
+// Windows上顺序/随机只能在打开文件时指定，这里只处理HINT_WILLNEED
+template<typename T>
+void MappedVec<T>::advise(MapHint hint) const
+{
+    if (base == nullptr)
+        return;
+
+#ifdef _WIN32
+#if _WIN32_WINNT >= 0x0602
+    if (hint == HINT_WILLNEED)
+    {
+        WIN32_MEMORY_RANGE_ENTRY range = { const_cast<T*>(base), bytes };
+        PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+    }
+#endif
+#else
+    static const int advice[] = { MADV_NORMAL, MADV_SEQUENTIAL, MADV_RANDOM, MADV_WILLNEED };
+    madvise(const_cast<T*>(base), bytes, advice[hint]); //只是提示，失败了也不影响正确性
+#endif
+}
+
+
+template<typename T>
+typename MappedVec<T>::const_ref MappedVec<T>::at(size_type n) const
+{
+    if (n >= count)
+        throw "illegal position";
+
+    return base[n];
+}
+
+
+
+/* 测试代码 */
+
+#if defined(DEBUG) && !defined(NO_MAIN)
+
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+int main(int argc, char* argv[])
+{
+    {
+        const char* path = "mappedvec_test.bin";
+        const char text[] = "line one\nline two\n";
+        FILE* f = fopen(path, "wb");
+        fwrite(text, 1, sizeof(text) - 1, f);
+        fclose(f);
+
+        MappedVec<char> m1(path, HINT_SEQUENTIAL);
+        assert(m1.is_open() && m1.size() == sizeof(text) - 1);
+        assert(memcmp(m1.data(), text, m1.size()) == 0);
+        assert(m1.front() == 'l' && m1.back() == '\n' && m1[5] == 'o' && m1.at(14) == 't');
+        assert(count(m1.begin(), m1.end(), '\n') == 2);
+        m1.advise(HINT_RANDOM);
+
+        MappedVec<char> m2(std::move(m1));
+        assert(!m1.is_open() && m1.empty() && m2.size() == sizeof(text) - 1);
+        m1 = std::move(m2);
+        assert(m1.size() == sizeof(text) - 1 && !m2.is_open());
+
+        MappedVec<int> m3(path); //18个字节，只有前4个int是完整的
+        int first;
+        memcpy(&first, text, sizeof(int));
+        assert(m3.size() == 4 && m3[0] == first);
+
+        bool thrown = false;
+        try { m3.at(4); }
+        catch (const char*) { thrown = true; }
+        assert(thrown);
+
+        m1.close();
+        m3.close();
+        f = fopen(path, "wb");
+        fclose(f);
+        MappedVec<char> m4(path); //空文件
+        assert(m4.empty() && m4.begin() == m4.end());
+        m4.close();
+        remove(path);
+
+        thrown = false;
+        try { MappedVec<char> m5("no_such_file.bin"); }
+        catch (const char*) { thrown = true; }
+        assert(thrown);
+    }
+
+    _CrtDumpMemoryLeaks();
+}
+
+#endif // DEBUG
+
+
+/* 性能测试代码 */
+
+#if defined(BENCHMARK) && !defined(NO_MAIN)
+
+#pragma push_macro("NO_MAIN")
+#define NO_MAIN
+#include "Vec.cpp"
+#pragma pop_macro("NO_MAIN")
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+
+static volatile size_t sink;
+
+double ms_since(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+
+size_t count_lines(const char* first, const char* last)
+{
+    size_t lines = 0;
+    for (size_t n = last - first, k; (k = bytes_find_char(first, n, '\n')) != BYTES_NPOS; first += k + 1, n -= k + 1)
+        ++lines;
+    return lines;
+}
+
+
+// 词典文件：每行一个单词；分别测量"可以开始使用"的时间、一次完整扫描和随机查找
+int main(int argc, char* argv[])
+{
+    size_t mb = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1024;
+    const char* path = "mappedvec_bench.txt";
+    {
+        ofstream out(path, ios::binary);
+        char word[32];
+        srand(1);
+        for (size_t written = 0; written < (mb << 20); )
+        {
+            size_t len = 4 + rand() % 12;
+            for (size_t i = 0; i < len; ++i)
+                word[i] = char('a' + rand() % 26);
+            word[len] = '\n';
+            out.write(word, len + 1);
+            written += len + 1;
+        }
+    }
+
+    // 现在的做法：用流把整个文件读进Vec<char>
+    auto start = chrono::steady_clock::now();
+    Vec<char> loaded;
+    {
+        ifstream in(path, ios::binary);
+        char buf[1 << 16];
+        while (in.read(buf, sizeof(buf)) || in.gcount() > 0)
+            loaded.insert(loaded.end(), buf, buf + in.gcount());
+    }
+    double load_ms = ms_since(start);
+    start = chrono::steady_clock::now();
+    size_t lines = count_lines(loaded.begin(), loaded.end());
+    double scan_ms = ms_since(start);
+    cout << "stream into Vec<char>: ready after " << load_ms << " ms, scan " << scan_ms << " ms, " << lines << " lines" << endl;
+
+    const size_t probes = 1000000;
+    for (int hint = HINT_NORMAL; hint <= HINT_WILLNEED; ++hint)
+    {
+        const char* names[] = { "normal", "sequential", "random", "willneed" };
+        start = chrono::steady_clock::now();
+        MappedVec<char> mapped(path, MapHint(hint));
+        double open_ms = ms_since(start);
+
+        start = chrono::steady_clock::now();
+        lines = count_lines(mapped.begin(), mapped.end());
+        scan_ms = ms_since(start);
+
+        start = chrono::steady_clock::now();
+        size_t acc = 0, x = 12345;
+        for (size_t i = 0; i < probes; ++i)
+        {
+            x = x * 6364136223846793005ull + 1442695040888963407ull;
+            acc += mapped[(x >> 16) % mapped.size()];
+        }
+        double probe_ms = ms_since(start);
+        sink = acc;
+
+        cout << "mmap, " << names[hint] << ": ready after " << open_ms << " ms, scan " << scan_ms << " ms, "
+             << probes << " random reads " << probe_ms << " ms, " << lines << " lines" << endl;
+    }
+
+    remove(path);
+}
+
+#endif // BENCHMARK
+
+#endif // MAPPEDVEC_CPP
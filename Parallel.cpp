@@ -0,0 +1,666 @@
+// 工作窃取线程池和基于它的并行算法：parallel_for / parallel_transform / parallel_reduce / parallel_sort
+// 每个工作线程有自己的任务队列，自己从队尾取（后进先出，刚拆分出的任务数据还在缓存中），空闲时从别的队列头部窃取（先进先出，偷到的是较大的任务）
+// 并行算法把区间对半拆分，直到长度不超过grain：一半作为任务交给线程池，另一半由当前线程继续拆分；等待时当前线程也会执行队列中的任务
+// grain为0时按线程数自动选择，让每个线程大约分到8段，负载不均时可以互相窃取
+
+#ifndef PARALLEL_CPP
+#define PARALLEL_CPP
+
+#pragma push_macro("NO_MAIN") //只引入实现，不引入它们的测试代码
+#define NO_MAIN
+#include "Vec.cpp"
+#pragma pop_macro("NO_MAIN")
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <exception>
+#include <iterator>
+#include <algorithm>
+#include <memory>
+#include <crtdbg.h>
+#include <assert.h>
+
+using namespace std;
+
+#ifndef BENCHMARK
+#define DEBUG
+#endif
+
+
+class ThreadPool
+{
+public:
+    typedef function<void()> Task;
+
+    explicit ThreadPool(size_t threads = thread::hardware_concurrency());
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    ~ThreadPool(); //先执行完已提交的任务，再结束工作线程
+
+    size_t size() const { return count; }
+    void submit(Task task);
+    bool run_one(); //在调用线程中执行一个待执行的任务，没有任务时返回false；等待任务完成的线程用它帮忙
+
+private:
+    struct WorkQueue
+    {
+        mutex lock;
+        deque<Task> tasks;
+    };
+
+    void worker_loop(size_t index);
+    bool pop_local(size_t index, Task& task);
+    bool steal(size_t thief, Task& task);
+
+    size_t count; //线程数，在启动线程之前确定，工作线程不读workers，因为构造时它还在增长
+    Vec<thread> workers;
+    unique_ptr<WorkQueue[]> queues;
+    atomic<size_t> pending; //已提交、还没有被取走的任务数
+    atomic<size_t> next_queue; //外部线程提交时轮流放入各个队列
+    mutex sleep_lock;
+    condition_variable wake;
+    bool stopping;
+
+    static thread_local ThreadPool* current_pool; //当前线程所属的线程池，不是工作线程时为nullptr
+    static thread_local size_t current_index;
+};
+
+thread_local ThreadPool* ThreadPool::current_pool = nullptr;
+thread_local size_t ThreadPool::current_index = 0;
+
+
+// 一组任务的fork-join：run提交任务，wait等待它们全部完成，并重新抛出任务中的第一个异常
+class TaskGroup
+{
+public:
+    explicit TaskGroup(ThreadPool& p): pool(p), outstanding(0) {}
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+    ~TaskGroup(); //没有调用wait时也等待任务完成，但不再抛出异常
+
+    template<typename F>
+    void run(F f);
+    void wait();
+
+private:
+    void wait_all();
+
+    ThreadPool& pool;
+    atomic<size_t> outstanding;
+    mutex error_lock;
+    exception_ptr error;
+};
+
+
+// 所有并行算法默认使用的线程池，线程数等于CPU核数
+inline ThreadPool& default_pool()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+
+
+/* ThreadPool公有成员函数的实现 */
+
+ThreadPool::ThreadPool(size_t threads): count(threads == 0 ? 1 : threads), queues(new WorkQueue[count]), pending(0), next_queue(0), stopping(false)
+{
+    workers.reserve(count);
+    for (size_t i = 0; i < count; ++i)
+        workers.push_back(thread(&ThreadPool::worker_loop, this, i));
+}
+
+
+ThreadPool::~ThreadPool()
+{
+    {
+        lock_guard<mutex> guard(sleep_lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (size_t i = 0; i < workers.size(); ++i)
+        workers[i].join();
+}
+
+
+// 工作线程提交的任务放入自己的队列，外部线程提交的任务轮流放入各个队列
+// 计数在sleep_lock下增加，工作线程在同一把锁下检查计数后才睡眠，不会错过唤醒
+void ThreadPool::submit(Task task)
+{
+    size_t index = current_pool == this ? current_index : next_queue.fetch_add(1, memory_order_relaxed) % count;
+    {
+        lock_guard<mutex> guard(queues[index].lock);
+        queues[index].tasks.push_back(std::move(task));
+    }
+    {
+        lock_guard<mutex> guard(sleep_lock);
+        ++pending;
+    }
+    wake.notify_one();
+}
+
+
+bool ThreadPool::run_one()
+{
+    Task task;
+    size_t self = current_pool == this ? current_index : count;
+    if ((self < count && pop_local(self, task)) || steal(self, task))
+    {
+        task();
+        return true;
+    }
+    return false;
+}
+
+
+
+/* ThreadPool私有成员函数的实现 */
+
+void ThreadPool::worker_loop(size_t index)
+{
+    current_pool = this;
+    current_index = index;
+    for (;;)
+    {
+        Task task;
+        if (pop_local(index, task) || steal(index, task))
+        {
+            task();
+            continue;
+        }
+
+        unique_lock<mutex> guard(sleep_lock);
+        wake.wait(guard, [this]() { return stopping || pending.load() > 0; });
+        if (stopping && pending.load() == 0)
+            return;
+    }
+}
+
+
+bool ThreadPool::pop_local(size_t index, Task& task)
+{
+    WorkQueue& q = queues[index];
+    lock_guard<mutex> guard(q.lock);
+    if (q.tasks.empty())
+        return false;
+
+    task = std::move(q.tasks.back());
+    q.tasks.pop_back();
+    --pending;
+    return true;
+}
+
+
+// 从thief的下一个队列开始依次尝试，避免所有空闲线程都去偷同一个队列
+bool ThreadPool::steal(size_t thief, Task& task)
+{
+    size_t n = count;
+    for (size_t k = 1; k <= n; ++k)
+    {
+        WorkQueue& q = queues[(thief + k) % n];
+        lock_guard<mutex> guard(q.lock);
+        if (q.tasks.empty())
+            continue;
+
+        task = std::move(q.tasks.front());
+        q.tasks.pop_front();
+        --pending;
+        return true;
+    }
+    return false;
+}
+
+
+
+/* TaskGroup成员函数的实现 */
+
+template<typename F>
+void TaskGroup::run(F f)
+{
+    ++outstanding;
+    pool.submit([this, f]() {
+        try
+        {
+            f();
+        }
+        catch (...)
+        {
+            lock_guard<mutex> guard(error_lock);
+            if (!error)
+                error = current_exception();
+        }
+        --outstanding;
+    });
+}
+
+
+void TaskGroup::wait()
+{
+    wait_all();
+    if (error)
+    {
+        exception_ptr e = error;
+        error = nullptr;
+        rethrow_exception(e);
+    }
+}
+
+
+TaskGroup::~TaskGroup()
+{
+    wait_all();
+}
+
+
+// 等待期间执行队列中的任务（不一定属于本组），这样嵌套的并行调用不会因为所有线程都在等待而死锁
+void TaskGroup::wait_all()
+{
+    while (outstanding.load() != 0)
+    {
+        if (!pool.run_one())
+            this_thread::yield();
+    }
+}
+
+
+
+/* 并行算法 */
+
+inline size_t default_grain(size_t n, ThreadPool& pool)
+{
+    return max<size_t>(n / (pool.size() * 8), 1024);
+}
+
+
+// 把[first, last)对半拆分，直到长度不超过grain，再对每一段调用leaf(first, last)
+template<typename It, typename Leaf>
+void split_range(It first, It last, size_t grain, ThreadPool& pool, const Leaf& leaf)
+{
+    size_t n = last - first;
+    if (n <= grain || pool.size() == 1)
+    {
+        leaf(first, last);
+        return;
+    }
+
+    It mid = first + n / 2;
+    TaskGroup group(pool);
+    group.run([=, &pool, &leaf]() { split_range(first, mid, grain, pool, leaf); });
+    split_range(mid, last, grain, pool, leaf);
+    group.wait();
+}
+
+
+// 对每个元素调用f(*it)
+template<typename It, typename F>
+void parallel_for(It first, It last, F f, size_t grain = 0, ThreadPool& pool = default_pool())
+{
+    if (grain == 0)
+        grain = default_grain(last - first, pool);
+    split_range(first, last, grain, pool, [&f](It b, It e) {
+        for (; b != e; ++b)
+            f(*b);
+    });
+}
+
+
+// out从dest开始，长度与输入相同，可以与输入相同（原地变换）
+template<typename In, typename Out, typename F>
+Out parallel_transform(In first, In last, Out dest, F f, size_t grain = 0, ThreadPool& pool = default_pool())
+{
+    if (grain == 0)
+        grain = default_grain(last - first, pool);
+    split_range(first, last, grain, pool, [first, dest, &f](In b, In e) {
+        transform(b, e, dest + (b - first), f);
+    });
+    return dest + (last - first);
+}
+
+
+// op必须满足结合律，每段内从左到右归约，段之间按原来的顺序合并，所以op不需要满足交换律
+template<typename It, typename T, typename Op>
+T reduce_range(It first, It last, size_t grain, ThreadPool& pool, const Op& op)
+{
+    size_t n = last - first;
+    if (n <= grain || pool.size() == 1)
+    {
+        T acc = *first;
+        for (++first; first != last; ++first)
+            acc = op(acc, *first);
+        return acc;
+    }
+
+    It mid = first + n / 2;
+    T left;
+    TaskGroup group(pool);
+    group.run([=, &left, &pool, &op]() { left = reduce_range<It, T>(first, mid, grain, pool, op); });
+    T right = reduce_range<It, T>(mid, last, grain, pool, op);
+    group.wait();
+    return op(left, right);
+}
+
+template<typename It, typename T, typename Op>
+T parallel_reduce(It first, It last, T init, Op op, size_t grain = 0, ThreadPool& pool = default_pool())
+{
+    if (first == last)
+        return init;
+    if (grain == 0)
+        grain = default_grain(last - first, pool);
+    return op(init, reduce_range<It, T>(first, last, grain, pool, op));
+}
+
+template<typename It, typename T>
+T parallel_reduce(It first, It last, T init, size_t grain = 0, ThreadPool& pool = default_pool())
+{
+    return parallel_reduce(first, last, init, plus<T>(), grain, pool);
+}
+
+
+// 把有序的[a1, a2)和[b1, b2)归并到dest：在较长的一段取中点，用二分查找在另一段中找到分界，两边独立归并
+// 总长不超过2时直接归并：grain为1时较长一段只有1个元素，中点就是a1，左边为空，右边和原问题一样，会无限递归
+template<typename It, typename Out, typename Comp>
+void parallel_merge(It a1, It a2, It b1, It b2, Out dest, size_t grain, ThreadPool& pool, const Comp& comp)
+{
+    size_t na = a2 - a1, nb = b2 - b1;
+    if (na + nb <= grain || na + nb <= 2 || pool.size() == 1)
+    {
+        merge(make_move_iterator(a1), make_move_iterator(a2), make_move_iterator(b1), make_move_iterator(b2), dest, comp);
+        return;
+    }
+    if (na < nb)
+    {
+        parallel_merge(b1, b2, a1, a2, dest, grain, pool, comp);
+        return;
+    }
+
+    It am = a1 + na / 2;
+    It bm = lower_bound(b1, b2, *am, comp);
+    Out dm = dest + (am - a1) + (bm - b1);
+    TaskGroup group(pool);
+    group.run([=, &pool, &comp]() { parallel_merge(a1, am, b1, bm, dest, grain, pool, comp); });
+    parallel_merge(am, a2, bm, b2, dm, grain, pool, comp);
+    group.wait();
+}
+
+
+// 两半并行排序后并行归并到buf，再并行搬回原处；不超过grain的段直接用std::sort
+template<typename It, typename Buf, typename Comp>
+void sort_range(It first, It last, Buf buf, size_t grain, ThreadPool& pool, const Comp& comp)
+{
+    size_t n = last - first;
+    if (n <= grain || pool.size() == 1)
+    {
+        sort(first, last, comp);
+        return;
+    }
+
+    It mid = first + n / 2;
+    {
+        TaskGroup group(pool);
+        group.run([=, &pool, &comp]() { sort_range(first, mid, buf, grain, pool, comp); });
+        sort_range(mid, last, buf + (n / 2), grain, pool, comp);
+        group.wait();
+    }
+    parallel_merge(first, mid, mid, last, buf, grain, pool, comp);
+    split_range(buf, buf + n, grain, pool, [buf, first](Buf b, Buf e) {
+        move(b, e, first + (b - buf));
+    });
+}
+
+// 需要一块与输入等长的缓冲区，元素类型需要可以默认构造和移动；排序不稳定
+template<typename It, typename Comp>
+void parallel_sort(It first, It last, Comp comp, size_t grain = 0, ThreadPool& pool = default_pool())
+{
+    size_t n = last - first;
+    if (n < 2)
+        return;
+    if (grain == 0)
+        grain = max<size_t>(default_grain(n, pool), 8192);
+
+    Vec<typename iterator_traits<It>::value_type> buf;
+    buf.resize(n);
+    sort_range(first, last, buf.begin(), grain, pool, comp);
+}
+
+template<typename It>
+void parallel_sort(It first, It last)
+{
+    parallel_sort(first, last, less<typename iterator_traits<It>::value_type>());
+}
+
+
+/* Vec的便捷重载 */
+
+template<typename T, typename G, typename A, typename F>
+void parallel_for(Vec<T, G, A>& v, F f, size_t grain = 0, ThreadPool& pool = default_pool())
+{
+    parallel_for(v.begin(), v.end(), f, grain, pool);
+}
+
+template<typename T, typename G, typename A, typename F>
+void parallel_transform(Vec<T, G, A>& v, F f, size_t grain = 0, ThreadPool& pool = default_pool()) //原地变换
+{
+    parallel_transform(v.begin(), v.end(), v.begin(), f, grain, pool);
+}
+
+template<typename T, typename G, typename A, typename U, typename Op>
+U parallel_reduce(const Vec<T, G, A>& v, U init, Op op, size_t grain = 0, ThreadPool& pool = default_pool())
+{
+    return parallel_reduce(v.begin(), v.end(), init, op, grain, pool);
+}
+
+template<typename T, typename G, typename A, typename Comp>
+void parallel_sort(Vec<T, G, A>& v, Comp comp, size_t grain = 0, ThreadPool& pool = default_pool())
+{
+    parallel_sort(v.begin(), v.end(), comp, grain, pool);
+}
+
+template<typename T, typename G, typename A>
+void parallel_sort(Vec<T, G, A>& v)
+{
+    parallel_sort(v.begin(), v.end(), less<T>());
+}
+
+
+
+/* 测试代码 */
+
+// 被其他文件include时，定义NO_MAIN来跳过这里的测试代码和性能测试代码
+#if defined(DEBUG) && !defined(NO_MAIN)
+
+#pragma push_macro("NO_MAIN")
+#define NO_MAIN
+#include "Str.cpp"
+#pragma pop_macro("NO_MAIN")
+#include <numeric>
+#include <cstdlib>
+
+int main(int argc, char* argv[])
+{
+    {
+        ThreadPool pool(4);
+        assert(pool.size() == 4);
+
+        // 各种长度，包括空区间和不足一个grain的区间
+        size_t sizes[] = { 0, 1, 7, 1000, 100000 };
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s)
+        {
+            size_t n = sizes[s];
+            Vec<long long> v;
+            for (size_t i = 0; i < n; ++i)
+                v.push_back((long long)((i * 2654435761u) % 100003));
+            Vec<long long> expected(v);
+
+            parallel_for(v.begin(), v.end(), [](long long& x) { x *= 2; }, 64, pool);
+            for (size_t i = 0; i < n; ++i)
+                assert(v[i] == expected[i] * 2);
+
+            Vec<long long> out(n, 0);
+            parallel_transform(v.begin(), v.end(), out.begin(), [](long long x) { return x + 1; }, 64, pool);
+            for (size_t i = 0; i < n; ++i)
+                assert(out[i] == v[i] + 1);
+
+            long long sum = parallel_reduce(v.begin(), v.end(), 10LL, plus<long long>(), 64, pool);
+            assert(sum == accumulate(v.begin(), v.end(), 10LL));
+
+            parallel_sort(v.begin(), v.end(), less<long long>(), 64, pool);
+            sort(expected.begin(), expected.end());
+            for (size_t i = 0; i < n; ++i)
+                assert(v[i] == expected[i] * 2);
+        }
+
+        // 不满足交换律的归约：字符串拼接必须保持原来的顺序
+        Vec<Str> words;
+        for (int i = 0; i < 500; ++i)
+            words.push_back(Str(1, char('a' + i % 26)));
+        Str joined = parallel_reduce(words.begin(), words.end(), Str(">"), [](const Str& a, const Str& b) { return Str(a + b); }, 16, pool);
+        assert(joined.size() == 501 && joined[0] == '>' && joined[1] == 'a' && joined[27] == 'a' && joined[500] == char('a' + 499 % 26));
+
+        // 自定义比较、Vec重载、默认线程池
+        Vec<int> d;
+        for (int i = 0; i < 50000; ++i)
+            d.push_back(rand());
+        parallel_sort(d, greater<int>(), 1000, pool);
+        assert(is_sorted(d.begin(), d.end(), greater<int>()));
+        parallel_transform(d, [](int x) { return x % 100; });
+        parallel_sort(d);
+        assert(is_sorted(d.begin(), d.end()) && d.back() < 100);
+        assert(parallel_reduce(d, 0LL, [](long long a, long long b) { return a + b; }) == accumulate(d.begin(), d.end(), 0LL));
+
+        // 嵌套：任务内部再调用并行算法，等待的线程会帮忙执行任务，不会死锁
+        Vec<Vec<int> > rows(64, Vec<int>());
+        for (size_t r = 0; r < rows.size(); ++r)
+            for (int i = 0; i < 2000; ++i)
+                rows[r].push_back(int((r * 31 + i * 17) % 1000));
+        atomic<long long> total(0);
+        parallel_for(rows.begin(), rows.end(), [&pool, &total](Vec<int>& row) {
+            parallel_sort(row.begin(), row.end(), less<int>(), 100, pool);
+            total += parallel_reduce(row.begin(), row.end(), 0LL, plus<long long>(), 100, pool);
+        }, 1, pool);
+        long long check = 0;
+        for (size_t r = 0; r < rows.size(); ++r)
+        {
+            assert(is_sorted(rows[r].begin(), rows[r].end()));
+            check += accumulate(rows[r].begin(), rows[r].end(), 0LL);
+        }
+        assert(total == check);
+
+        // 任务中的异常在wait时重新抛出
+        bool thrown = false;
+        try
+        {
+            parallel_for(d.begin(), d.end(), [](int x) { if (x == 42) throw "found 42"; }, 100, pool);
+        }
+        catch (const char*) { thrown = true; }
+        assert(thrown == (find(d.begin(), d.end(), 42) != d.end()));
+
+        TaskGroup group(pool);
+        atomic<int> ran(0);
+        for (int i = 0; i < 100; ++i)
+            group.run([&ran]() { ++ran; });
+        group.wait();
+        assert(ran == 100);
+
+        for (size_t g = 1; g <= 5; ++g) //很小的grain会一直拆分到只剩一两个元素
+        {
+            Vec<int> small;
+            for (int i = 0; i < 300; ++i)
+                small.push_back((i * 37) % 101);
+            parallel_sort(small, less<int>(), g, pool);
+            assert(is_sorted(small.begin(), small.end()));
+        }
+
+        ThreadPool single(1); //只有一个线程时不拆分
+        Vec<int> s1(d);
+        parallel_sort(s1, greater<int>(), 10, single);
+        assert(is_sorted(s1.begin(), s1.end(), greater<int>()));
+    }
+
+    _CrtDumpMemoryLeaks();
+}
+
+#endif // DEBUG
+
+
+/* 性能测试代码 */
+
+#if defined(BENCHMARK) && !defined(NO_MAIN)
+
+#include <chrono>
+#include <cstdlib>
+#include <cmath>
+#include <numeric>
+
+double ms_since(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+
+Vec<unsigned> random_data(size_t n)
+{
+    Vec<unsigned> v;
+    v.reserve(n);
+    unsigned long long x = 88172645463325252ull;
+    for (size_t i = 0; i < n; ++i)
+    {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        v.push_back(unsigned(x));
+    }
+    return v;
+}
+
+
+// 线程数从1翻倍到CPU核数，每一行都和单线程的标准库算法比较
+int main(int argc, char* argv[])
+{
+    size_t n = argc > 1 ? strtoul(argv[1], nullptr, 10) : 20000000;
+    size_t cores = thread::hardware_concurrency();
+    if (cores == 0)
+        cores = 1;
+
+    Vec<unsigned> data = random_data(n);
+    Vec<double> out(n, 0.0);
+    auto heavy = [](unsigned x) { return sqrt(double(x)) * 1.5 + log1p(double(x & 1023)); };
+
+    Vec<unsigned> v(data);
+    auto start = chrono::steady_clock::now();
+    sort(v.begin(), v.end());
+    double sort_ms = ms_since(start);
+    start = chrono::steady_clock::now();
+    transform(data.begin(), data.end(), out.begin(), heavy);
+    double transform_ms = ms_since(start);
+    start = chrono::steady_clock::now();
+    unsigned long long sum = accumulate(data.begin(), data.end(), 0ULL);
+    double reduce_ms = ms_since(start);
+    cout << n << " elements, std serial: sort " << sort_ms << " ms, transform " << transform_ms << " ms, reduce " << reduce_ms << " ms" << endl;
+
+    for (size_t threads = 1; threads <= cores; threads = (threads * 2 > cores && threads < cores) ? cores : threads * 2) //1, 2, 4...，最后一行总是用全部核心
+    {
+        ThreadPool pool(threads);
+        v = data;
+        start = chrono::steady_clock::now();
+        parallel_sort(v.begin(), v.end(), less<unsigned>(), 0, pool);
+        sort_ms = ms_since(start);
+        start = chrono::steady_clock::now();
+        parallel_transform(data.begin(), data.end(), out.begin(), heavy, 0, pool);
+        transform_ms = ms_since(start);
+        start = chrono::steady_clock::now();
+        unsigned long long psum = parallel_reduce(data.begin(), data.end(), 0ULL, plus<unsigned long long>(), 0, pool);
+        reduce_ms = ms_since(start);
+        start = chrono::steady_clock::now();
+        parallel_for(v.begin(), v.end(), [](unsigned& x) { x = x * 2654435761u; }, 0, pool);
+        double for_ms = ms_since(start);
+        cout << threads << " thread(s): sort " << sort_ms << " ms, transform " << transform_ms << " ms, reduce " << reduce_ms
+             << " ms, for " << for_ms << " ms" << (psum == sum ? "" : " (mismatch)") << endl;
+    }
+}
+
+#endif // BENCHMARK
+
+#endif // PARALLEL_CPP
@@ -0,0 +1,795 @@
+// 字节序列的比较、查找和哈希，Str和Vec<char>等容器的operator==、find等操作都建立在这些函数之上
+// x86上有SSE2和AVX2两套向量化实现，程序启动后第一次调用时根据CPU支持的指令集选择其一
+// 其他平台以及不支持的CPU使用标量实现（尽量交给libc的memcmp/memchr）
+
+#ifndef SIMD_CPP
+#define SIMD_CPP
+
+#include <cstring>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <iostream>
+#include <assert.h>
+#include <crtdbg.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SIMD_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_AVX2 //MSVC不需要额外的编译选项就能使用AVX2指令
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+using namespace std;
+
+#ifndef BENCHMARK
+#define DEBUG
+#endif
+
+enum SimdLevel { SIMD_SCALAR = 0, SIMD_SSE2 = 1, SIMD_AVX2 = 2 };
+
+static const size_t BYTES_NPOS = size_t(-1); //查找失败时的返回值
+
+
+/* 标量实现 */
+
+inline bool scalar_equal(const char* a, const char* b, size_t n)
+{
+    return n == 0 || memcmp(a, b, n) == 0;
+}
+
+inline int scalar_compare(const char* a, const char* b, size_t n)
+{
+    return n == 0 ? 0 : memcmp(a, b, n);
+}
+
+inline size_t scalar_find_char(const char* p, size_t n, char c)
+{
+    const void* hit = n == 0 ? nullptr : memchr(p, c, n);
+    return hit ? static_cast<const char*>(hit) - p : BYTES_NPOS;
+}
+
+inline size_t scalar_rfind_char(const char* p, size_t n, char c)
+{
+    while (n != 0)
+    {
+        if (p[--n] == c)
+            return n;
+    }
+    return BYTES_NPOS;
+}
+
+// 与C locale下的isspace相同：空格和'\t' '\n' '\v' '\f' '\r'
+inline bool is_space_byte(char c)
+{
+    return c == ' ' || static_cast<unsigned char>(c - '\t') <= '\r' - '\t';
+}
+
+// space为true时查找第一个空白字符，为false时查找第一个非空白字符
+inline size_t scalar_find_space(const char* p, size_t n, bool space)
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (is_space_byte(p[i]) == space)
+            return i;
+    }
+    return BYTES_NPOS;
+}
+
+// 调用前保证 2 <= m <= n
+inline size_t scalar_find(const char* h, size_t n, const char* needle, size_t m)
+{
+    for (size_t i = 0; i + m <= n; ++i)
+    {
+        size_t hit = scalar_find_char(h + i, n - m + 1 - i, needle[0]);
+        if (hit == BYTES_NPOS)
+            return BYTES_NPOS;
+        i += hit;
+        if (memcmp(h + i + 1, needle + 1, m - 1) == 0)
+            return i;
+    }
+    return BYTES_NPOS;
+}
+
+
+
+#ifdef SIMD_X86
+
+/* 位运算辅助函数，mask不能为0 */
+
+inline unsigned lowest_bit(unsigned mask)
+{
+#ifdef _MSC_VER
+    unsigned long idx;
+    _BitScanForward(&idx, mask);
+    return idx;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+inline unsigned highest_bit(unsigned mask)
+{
+#ifdef _MSC_VER
+    unsigned long idx;
+    _BitScanReverse(&idx, mask);
+    return idx;
+#else
+    return 31 - __builtin_clz(mask);
+#endif
+}
+
+
+/* SSE2实现，每次处理16个字节；长数据每轮处理4个向量，合并结果后只判断一次，减少分支 */
+
+inline __m128i sse2_load(const char* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+
+inline bool sse2_equal(const char* a, const char* b, size_t n)
+{
+    if (n < 16)
+        return scalar_equal(a, b, n);
+
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64)
+    {
+        __m128i diff = _mm_or_si128(_mm_or_si128(_mm_xor_si128(sse2_load(a + i), sse2_load(b + i)), _mm_xor_si128(sse2_load(a + i + 16), sse2_load(b + i + 16))),
+                                    _mm_or_si128(_mm_xor_si128(sse2_load(a + i + 32), sse2_load(b + i + 32)), _mm_xor_si128(sse2_load(a + i + 48), sse2_load(b + i + 48))));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(diff, _mm_setzero_si128())) != 0xFFFF)
+            return false;
+    }
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) != 0xFFFF)
+            return false;
+    }
+
+    // 剩余不足16个字节时，让最后一块与前一块重叠，避免逐字节比较
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + n - 16));
+    __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + n - 16));
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) == 0xFFFF;
+}
+
+inline int sse2_compare(const char* a, const char* b, size_t n)
+{
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64) //发现不同后交给下面的循环定位
+    {
+        __m128i same = _mm_and_si128(_mm_and_si128(_mm_cmpeq_epi8(sse2_load(a + i), sse2_load(b + i)), _mm_cmpeq_epi8(sse2_load(a + i + 16), sse2_load(b + i + 16))),
+                                     _mm_and_si128(_mm_cmpeq_epi8(sse2_load(a + i + 32), sse2_load(b + i + 32)), _mm_cmpeq_epi8(sse2_load(a + i + 48), sse2_load(b + i + 48))));
+        if (_mm_movemask_epi8(same) != 0xFFFF)
+            break;
+    }
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        unsigned diff = ~unsigned(_mm_movemask_epi8(_mm_cmpeq_epi8(x, y))) & 0xFFFF;
+        if (diff != 0)
+        {
+            size_t k = i + lowest_bit(diff); //第一个不相同的字节
+            return int((unsigned char)a[k]) - int((unsigned char)b[k]);
+        }
+    }
+    return scalar_compare(a + i, b + i, n - i);
+}
+
+inline size_t sse2_find_char(const char* p, size_t n, char c)
+{
+    __m128i target = _mm_set1_epi8(c);
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64)
+    {
+        __m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(sse2_load(p + i), target), _mm_cmpeq_epi8(sse2_load(p + i + 16), target)),
+                                   _mm_or_si128(_mm_cmpeq_epi8(sse2_load(p + i + 32), target), _mm_cmpeq_epi8(sse2_load(p + i + 48), target)));
+        if (_mm_movemask_epi8(hit) != 0)
+            break;
+    }
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(x, target));
+        if (mask != 0)
+            return i + lowest_bit(mask);
+    }
+    size_t hit = scalar_find_char(p + i, n - i, c);
+    return hit == BYTES_NPOS ? hit : i + hit;
+}
+
+inline size_t sse2_rfind_char(const char* p, size_t n, char c)
+{
+    __m128i target = _mm_set1_epi8(c);
+    size_t i = n;
+    for (; i >= 64; i -= 64)
+    {
+        __m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(sse2_load(p + i - 64), target), _mm_cmpeq_epi8(sse2_load(p + i - 48), target)),
+                                   _mm_or_si128(_mm_cmpeq_epi8(sse2_load(p + i - 32), target), _mm_cmpeq_epi8(sse2_load(p + i - 16), target)));
+        if (_mm_movemask_epi8(hit) != 0)
+            break;
+    }
+    for (; i >= 16; i -= 16)
+    {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i - 16));
+        unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(x, target));
+        if (mask != 0)
+            return i - 16 + highest_bit(mask);
+    }
+    return scalar_rfind_char(p, i, c);
+}
+
+// 空白字符对应的字节为0xFF：'\t'到'\r'减去9之后落在[0, 4]，用无符号的min判断范围
+inline __m128i sse2_space_mask(__m128i x)
+{
+    __m128i shifted = _mm_sub_epi8(x, _mm_set1_epi8('\t'));
+    __m128i ctrl = _mm_cmpeq_epi8(_mm_min_epu8(shifted, _mm_set1_epi8('\r' - '\t')), shifted);
+    return _mm_or_si128(ctrl, _mm_cmpeq_epi8(x, _mm_set1_epi8(' ')));
+}
+
+inline size_t sse2_find_space(const char* p, size_t n, bool space)
+{
+    unsigned flip = space ? 0 : 0xFFFF; //查找非空白字符时把掩码取反
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        unsigned mask = unsigned(_mm_movemask_epi8(sse2_space_mask(sse2_load(p + i)))) ^ flip;
+        if (mask != 0)
+            return i + lowest_bit(mask);
+    }
+    size_t hit = scalar_find_space(p + i, n - i, space);
+    return hit == BYTES_NPOS ? hit : i + hit;
+}
+
+// 同时比较子串的首字符和尾字符，两者都匹配的位置才用memcmp验证，大部分位置一次向量比较即可排除
+inline size_t sse2_find(const char* h, size_t n, const char* needle, size_t m)
+{
+    __m128i first = _mm_set1_epi8(needle[0]);
+    __m128i last = _mm_set1_epi8(needle[m - 1]);
+    size_t i = 0;
+    for (; i + m - 1 + 16 <= n; i += 16)
+    {
+        __m128i block_first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(h + i));
+        __m128i block_last = _mm_loadu_si128(reinterpret_cast<const __m128i*>(h + i + m - 1));
+        unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(block_first, first), _mm_cmpeq_epi8(block_last, last)));
+        while (mask != 0)
+        {
+            size_t k = i + lowest_bit(mask);
+            if (memcmp(h + k + 1, needle + 1, m - 2) == 0)
+                return k;
+            mask &= mask - 1;
+        }
+    }
+    size_t hit = i + m <= n ? scalar_find(h + i, n - i, needle, m) : BYTES_NPOS;
+    return hit == BYTES_NPOS ? hit : i + hit;
+}
+
+
+/* AVX2实现，每次处理32个字节，算法与SSE2版本相同 */
+
+TARGET_AVX2 inline __m256i avx2_load(const char* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+
+TARGET_AVX2 inline bool avx2_equal(const char* a, const char* b, size_t n)
+{
+    if (n < 32)
+        return sse2_equal(a, b, n);
+
+    size_t i = 0;
+    for (; i + 128 <= n; i += 128)
+    {
+        __m256i diff = _mm256_or_si256(_mm256_or_si256(_mm256_xor_si256(avx2_load(a + i), avx2_load(b + i)), _mm256_xor_si256(avx2_load(a + i + 32), avx2_load(b + i + 32))),
+                                       _mm256_or_si256(_mm256_xor_si256(avx2_load(a + i + 64), avx2_load(b + i + 64)), _mm256_xor_si256(avx2_load(a + i + 96), avx2_load(b + i + 96))));
+        if (!_mm256_testz_si256(diff, diff))
+            return false;
+    }
+    for (; i + 32 <= n; i += 32)
+    {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+        if (unsigned(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y))) != 0xFFFFFFFFu)
+            return false;
+    }
+
+    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + n - 32));
+    __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + n - 32));
+    return unsigned(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y))) == 0xFFFFFFFFu;
+}
+
+TARGET_AVX2 inline int avx2_compare(const char* a, const char* b, size_t n)
+{
+    size_t i = 0;
+    for (; i + 128 <= n; i += 128)
+    {
+        __m256i diff = _mm256_or_si256(_mm256_or_si256(_mm256_xor_si256(avx2_load(a + i), avx2_load(b + i)), _mm256_xor_si256(avx2_load(a + i + 32), avx2_load(b + i + 32))),
+                                       _mm256_or_si256(_mm256_xor_si256(avx2_load(a + i + 64), avx2_load(b + i + 64)), _mm256_xor_si256(avx2_load(a + i + 96), avx2_load(b + i + 96))));
+        if (!_mm256_testz_si256(diff, diff))
+            break;
+    }
+    for (; i + 32 <= n; i += 32)
+    {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+        unsigned diff = ~unsigned(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y)));
+        if (diff != 0)
+        {
+            size_t k = i + lowest_bit(diff);
+            return int((unsigned char)a[k]) - int((unsigned char)b[k]);
+        }
+    }
+    return sse2_compare(a + i, b + i, n - i);
+}
+
+TARGET_AVX2 inline size_t avx2_find_char(const char* p, size_t n, char c)
+{
+    __m256i target = _mm256_set1_epi8(c);
+    size_t i = 0;
+    for (; i + 128 <= n; i += 128)
+    {
+        __m256i hit = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(avx2_load(p + i), target), _mm256_cmpeq_epi8(avx2_load(p + i + 32), target)),
+                                      _mm256_or_si256(_mm256_cmpeq_epi8(avx2_load(p + i + 64), target), _mm256_cmpeq_epi8(avx2_load(p + i + 96), target)));
+        if (!_mm256_testz_si256(hit, hit))
+            break;
+    }
+    for (; i + 32 <= n; i += 32)
+    {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+        unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(x, target));
+        if (mask != 0)
+            return i + lowest_bit(mask);
+    }
+    size_t hit = sse2_find_char(p + i, n - i, c);
+    return hit == BYTES_NPOS ? hit : i + hit;
+}
+
+TARGET_AVX2 inline size_t avx2_rfind_char(const char* p, size_t n, char c)
+{
+    __m256i target = _mm256_set1_epi8(c);
+    size_t i = n;
+    for (; i >= 128; i -= 128)
+    {
+        __m256i hit = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(avx2_load(p + i - 128), target), _mm256_cmpeq_epi8(avx2_load(p + i - 96), target)),
+                                      _mm256_or_si256(_mm256_cmpeq_epi8(avx2_load(p + i - 64), target), _mm256_cmpeq_epi8(avx2_load(p + i - 32), target)));
+        if (!_mm256_testz_si256(hit, hit))
+            break;
+    }
+    for (; i >= 32; i -= 32)
+    {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i - 32));
+        unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(x, target));
+        if (mask != 0)
+            return i - 32 + highest_bit(mask);
+    }
+    return sse2_rfind_char(p, i, c);
+}
+
+TARGET_AVX2 inline __m256i avx2_space_mask(__m256i x)
+{
+    __m256i shifted = _mm256_sub_epi8(x, _mm256_set1_epi8('\t'));
+    __m256i ctrl = _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, _mm256_set1_epi8('\r' - '\t')), shifted);
+    return _mm256_or_si256(ctrl, _mm256_cmpeq_epi8(x, _mm256_set1_epi8(' ')));
+}
+
+TARGET_AVX2 inline size_t avx2_find_space(const char* p, size_t n, bool space)
+{
+    unsigned flip = space ? 0 : 0xFFFFFFFFu;
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        unsigned mask = unsigned(_mm256_movemask_epi8(avx2_space_mask(avx2_load(p + i)))) ^ flip;
+        if (mask != 0)
+            return i + lowest_bit(mask);
+    }
+    size_t hit = sse2_find_space(p + i, n - i, space);
+    return hit == BYTES_NPOS ? hit : i + hit;
+}
+
+TARGET_AVX2 inline size_t avx2_find(const char* h, size_t n, const char* needle, size_t m)
+{
+    __m256i first = _mm256_set1_epi8(needle[0]);
+    __m256i last = _mm256_set1_epi8(needle[m - 1]);
+    size_t i = 0;
+    for (; i + m - 1 + 32 <= n; i += 32)
+    {
+        __m256i block_first = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(h + i));
+        __m256i block_last = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(h + i + m - 1));
+        unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(block_first, first), _mm256_cmpeq_epi8(block_last, last)));
+        while (mask != 0)
+        {
+            size_t k = i + lowest_bit(mask);
+            if (memcmp(h + k + 1, needle + 1, m - 2) == 0)
+                return k;
+            mask &= mask - 1;
+        }
+    }
+    size_t hit = i + m <= n ? sse2_find(h + i, n - i, needle, m) : BYTES_NPOS;
+    return hit == BYTES_NPOS ? hit : i + hit;
+}
+
+#endif // SIMD_X86
+
+
+
+/* 运行时分派 */
+
+struct SimdOps
+{
+    bool (*equal)(const char*, const char*, size_t);
+    int (*compare)(const char*, const char*, size_t);
+    size_t (*find_char)(const char*, size_t, char);
+    size_t (*rfind_char)(const char*, size_t, char);
+    size_t (*find)(const char*, size_t, const char*, size_t);
+    size_t (*find_space)(const char*, size_t, bool);
+};
+
+inline int detect_simd_level()
+{
+#if defined(SIMD_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] >= 7)
+    {
+        __cpuid(info, 1);
+        bool os_avx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)); //OSXSAVE和AVX
+        __cpuidex(info, 7, 0);
+        bool avx2 = (info[1] & (1 << 5)) != 0;
+        if (os_avx && avx2 && (_xgetbv(0) & 6) == 6) //操作系统会保存YMM寄存器
+            return SIMD_AVX2;
+    }
+    return SIMD_SSE2;
+#elif defined(SIMD_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return SIMD_AVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return SIMD_SSE2;
+    return SIMD_SCALAR;
+#else
+    return SIMD_SCALAR;
+#endif
+}
+
+inline const SimdOps& simd_ops_for(int level)
+{
+    static const SimdOps scalar = { scalar_equal, scalar_compare, scalar_find_char, scalar_rfind_char, scalar_find, scalar_find_space };
+#ifdef SIMD_X86
+    static const SimdOps sse2 = { sse2_equal, sse2_compare, sse2_find_char, sse2_rfind_char, sse2_find, sse2_find_space };
+    static const SimdOps avx2 = { avx2_equal, avx2_compare, avx2_find_char, avx2_rfind_char, avx2_find, avx2_find_space };
+    if (level >= SIMD_AVX2)
+        return avx2;
+    if (level >= SIMD_SSE2)
+        return sse2;
+#endif
+    return scalar;
+}
+
+inline const SimdOps*& current_simd_ops()
+{
+    static const SimdOps* ops = &simd_ops_for(detect_simd_level()); //C++11保证局部静态变量的初始化是线程安全的
+    return ops;
+}
+
+inline int& current_simd_level()
+{
+    static int level = detect_simd_level();
+    return level;
+}
+
+// 主要用于测试和性能对比：强制使用较低的指令集，不能超过CPU实际支持的级别
+inline void set_simd_level(int level)
+{
+    level = min(level, detect_simd_level());
+    current_simd_level() = level;
+    current_simd_ops() = &simd_ops_for(level);
+}
+
+
+
+/* 对外的接口 */
+
+inline bool bytes_equal(const char* a, const char* b, size_t n)
+{
+    return current_simd_ops()->equal(a, b, n);
+}
+
+// 与memcmp一样按无符号字节比较，返回值的正负表示大小
+inline int bytes_compare(const char* a, const char* b, size_t n)
+{
+    return current_simd_ops()->compare(a, b, n);
+}
+
+inline size_t bytes_find_char(const char* p, size_t n, char c)
+{
+    return current_simd_ops()->find_char(p, n, c);
+}
+
+inline size_t bytes_rfind_char(const char* p, size_t n, char c)
+{
+    return current_simd_ops()->rfind_char(p, n, c);
+}
+
+// 查找第一个空白字符，用于按空白切分单词
+inline size_t bytes_find_space(const char* p, size_t n)
+{
+    return current_simd_ops()->find_space(p, n, true);
+}
+
+// 查找第一个非空白字符，用于跳过单词之间的空白
+inline size_t bytes_find_nonspace(const char* p, size_t n)
+{
+    return current_simd_ops()->find_space(p, n, false);
+}
+
+// 在h[0, n)中查找needle[0, m)第一次出现的位置，空串出现在位置0
+inline size_t bytes_find(const char* h, size_t n, const char* needle, size_t m)
+{
+    if (m == 0)
+        return 0;
+    if (m > n)
+        return BYTES_NPOS;
+    if (m == 1)
+        return bytes_find_char(h, n, needle[0]);
+    return current_simd_ops()->find(h, n, needle, m);
+}
+
+// 从后往前查找：先用向量化的rfind_char定位首字符，再验证剩余部分
+inline size_t bytes_rfind(const char* h, size_t n, const char* needle, size_t m)
+{
+    if (m > n)
+        return BYTES_NPOS;
+    if (m == 0)
+        return n;
+
+    size_t end = n - m + 1; //候选的起始位置在[0, end)之间
+    while (end != 0)
+    {
+        size_t k = bytes_rfind_char(h, end, needle[0]);
+        if (k == BYTES_NPOS)
+            return BYTES_NPOS;
+        if (memcmp(h + k + 1, needle + 1, m - 1) == 0)
+            return k;
+        end = k;
+    }
+    return BYTES_NPOS;
+}
+
+
+
+/* 哈希 */
+
+// wyhash风格的哈希：每次读入8字节，用64x64->128位乘法把高低两半异或来混合
+// 对短键只需要一两次乘法，长键每48字节三路并行，适合作为哈希表的键
+
+inline void hash_mum(uint64_t* a, uint64_t* b)
+{
+#if defined(__SIZEOF_INT128__)
+    __uint128_t r = __uint128_t(*a) * *b;
+    *a = uint64_t(r);
+    *b = uint64_t(r >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    *a = _umul128(*a, *b, b);
+#else
+    uint64_t ha = *a >> 32, hb = *b >> 32, la = uint32_t(*a), lb = uint32_t(*b);
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb, t = rl + (rm0 << 32), c = t < rl;
+    uint64_t lo = t + (rm1 << 32);
+    c += lo < t;
+    *a = lo;
+    *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+inline uint64_t hash_mix(uint64_t a, uint64_t b)
+{
+    hash_mum(&a, &b);
+    return a ^ b;
+}
+
+inline uint64_t hash_read8(const unsigned char* p) { uint64_t v; memcpy(&v, p, 8); return v; }
+inline uint64_t hash_read4(const unsigned char* p) { uint32_t v; memcpy(&v, p, 4); return v; }
+inline uint64_t hash_read3(const unsigned char* p, size_t k) { return (uint64_t(p[0]) << 16) | (uint64_t(p[k >> 1]) << 8) | p[k - 1]; }
+
+inline uint64_t bytes_hash(const char* key, size_t len, uint64_t seed = 0)
+{
+    static const uint64_t secret[4] = { 0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull, 0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull };
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(key);
+    uint64_t a, b;
+
+    seed ^= hash_mix(seed ^ secret[0], secret[1]);
+    if (len <= 16)
+    {
+        if (len >= 4)
+        {
+            a = (hash_read4(p) << 32) | hash_read4(p + ((len >> 3) << 2));
+            b = (hash_read4(p + len - 4) << 32) | hash_read4(p + len - 4 - ((len >> 3) << 2));
+        }
+        else if (len > 0)
+        {
+            a = hash_read3(p, len);
+            b = 0;
+        }
+        else
+            a = b = 0;
+    }
+    else
+    {
+        size_t i = len;
+        if (i > 48)
+        {
+            uint64_t see1 = seed, see2 = seed;
+            do
+            {
+                seed = hash_mix(hash_read8(p) ^ secret[1], hash_read8(p + 8) ^ seed);
+                see1 = hash_mix(hash_read8(p + 16) ^ secret[2], hash_read8(p + 24) ^ see1);
+                see2 = hash_mix(hash_read8(p + 32) ^ secret[3], hash_read8(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16)
+        {
+            seed = hash_mix(hash_read8(p) ^ secret[1], hash_read8(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+        a = hash_read8(p + i - 16);
+        b = hash_read8(p + i - 8);
+    }
+
+    a ^= secret[1];
+    b ^= seed;
+    hash_mum(&a, &b);
+    return hash_mix(a ^ secret[0] ^ len, b ^ secret[1]);
+}
+
+
+
+/* 测试代码 */
+
+#if defined(DEBUG) && !defined(NO_MAIN)
+
+int main(int argc, char* argv[])
+{
+    {
+        char buf[300];
+        for (int i = 0; i < 300; ++i)
+            buf[i] = char('a' + i % 26);
+        char other[300];
+        memcpy(other, buf, 300);
+
+        // 每个指令集都与标量结果对照，覆盖跨越向量边界的各种长度和位置
+        for (int level = detect_simd_level(); level >= SIMD_SCALAR; --level)
+        {
+            set_simd_level(level);
+            for (size_t n = 0; n <= 100; ++n)
+            {
+                assert(bytes_equal(buf, other, n));
+                assert(bytes_compare(buf, other, n) == 0);
+                for (size_t k = 0; k < n; ++k)
+                {
+                    other[k] = '#';
+                    assert(!bytes_equal(buf, other, n));
+                    assert((bytes_compare(buf, other, n) > 0) == (buf[k] > '#'));
+                    assert(bytes_find_char(other, n, '#') == k && bytes_rfind_char(other, n, '#') == k);
+                    other[k] = char(0xF0); //按无符号比较，0xF0大于任何小写字母
+                    assert(bytes_compare(buf, other, n) < 0);
+                    other[k] = buf[k];
+                }
+                assert(bytes_find_char(buf, n, '#') == BYTES_NPOS && bytes_rfind_char(buf, n, '#') == BYTES_NPOS);
+            }
+
+            char text[100];
+            for (size_t n = 0; n < 100; ++n)
+            {
+                memset(text, 'w', sizeof(text));
+                assert(bytes_find_space(text, n) == BYTES_NPOS && bytes_find_nonspace(text, n) == (n ? 0 : BYTES_NPOS));
+                if (n == 0)
+                    continue;
+                text[n - 1] = " \t\n\v\f\r"[n % 6];
+                assert(bytes_find_space(text, n) == n - 1);
+                memset(text, ' ', n - 1);
+                text[n - 1] = n % 2 ? '\x08' : '\x0E'; //紧挨着'\t'和'\r'的控制字符不是空白
+                assert(bytes_find_nonspace(text, n) == n - 1 && bytes_find_space(text + n - 1, 1) == BYTES_NPOS);
+            }
+
+            assert(bytes_find(buf, 300, "xyz", 3) == 23);
+            assert(bytes_rfind(buf, 300, "xyz", 3) == 283);
+            assert(bytes_find(buf, 300, "xyzabcdefghijklmnopqrstuvwxyzab", 31) == 23);
+            assert(bytes_rfind(buf, 300, "ab", 2) == 286);
+            assert(bytes_find(buf, 300, "ba", 2) == BYTES_NPOS && bytes_rfind(buf, 300, "ba", 2) == BYTES_NPOS);
+            assert(bytes_find(buf + 286, 14, "efghij", 6) == 4);
+            assert(bytes_find(buf, 5, "", 0) == 0 && bytes_rfind(buf, 5, "", 0) == 5);
+            assert(bytes_find(buf, 2, "abc", 3) == BYTES_NPOS);
+            assert(bytes_find(buf, 26, "z", 1) == 25 && bytes_rfind(buf, 27, "a", 1) == 26);
+        }
+        set_simd_level(detect_simd_level());
+
+        assert(bytes_hash("hello", 5) == bytes_hash("hello", 5));
+        assert(bytes_hash("hello", 5) != bytes_hash("hellp", 5));
+        assert(bytes_hash("hello", 5) != bytes_hash("hello", 5, 1));
+        assert(bytes_hash(buf, 100) != bytes_hash(buf + 1, 100));
+        assert(bytes_hash(buf, 0) != bytes_hash(buf, 1));
+    }
+
+    _CrtDumpMemoryLeaks();
+}
+
+#endif // DEBUG
+
+
+/* 性能测试代码 */
+
+#if defined(BENCHMARK) && !defined(NO_MAIN)
+
+#pragma push_macro("NO_MAIN")
+#define NO_MAIN
+#include "Vec.cpp" //Vec.cpp本身引用了这个文件，这里的声明已经完整
+#pragma pop_macro("NO_MAIN")
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+static volatile size_t sink; //防止结果被优化掉
+
+// 对每种长度和每个指令集，测量单次操作的纳秒数
+template<typename Op>
+double time_op(size_t len, Op op)
+{
+    size_t iters = max<size_t>(1000, (size_t(1) << 26) / (len + 16));
+    size_t acc = 0;
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < iters; ++i)
+        acc += op();
+    double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+    sink = acc;
+    return ns / iters;
+}
+
+
+int main(int argc, char* argv[])
+{
+    const size_t lengths[] = { 8, 16, 32, 64, 256, 1024, 4096, 65536 };
+    const char* names[] = { "scalar", "sse2", "avx2" };
+
+    Vec<char> a(65536 + 64), b;
+    for (size_t i = 0; i < a.size(); ++i)
+        a[i] = char('a' + i % 23);
+    b = a;
+    const char needle[] = "needle";
+
+    cout << "ns/op        len  equal compare  find_c rfind_c    find    hash" << endl;
+    for (int level = SIMD_SCALAR; level <= detect_simd_level(); ++level)
+    {
+        set_simd_level(level);
+        for (size_t li = 0; li < sizeof(lengths) / sizeof(lengths[0]); ++li)
+        {
+            size_t len = lengths[li];
+            // 最坏情况：相等的两块内存比较到最后，正向查找的目标在末尾，反向查找的目标在开头
+            memcpy(&a[len - 7], needle, 6);
+            memcpy(&b[len - 7], needle, 6);
+            a[len - 1] = b[len - 1] = '#';
+            a[0] = b[0] = '@';
+            // 通过volatile读取指针，避免编译器把结果相同的调用提到循环外
+            const char* volatile pa = a.begin();
+            const char* volatile pb = b.begin();
+
+            double eq = time_op(len, [&]() { return size_t(bytes_equal(pa, pb, len)); });
+            double cmp = time_op(len, [&]() { return size_t(bytes_compare(pa, pb, len) + 1); });
+            double fc = time_op(len, [&]() { return bytes_find_char(pa, len, '#'); });
+            double rfc = time_op(len, [&]() { return bytes_rfind_char(pa, len, '@'); });
+            double fs = time_op(len, [&]() { return bytes_find(pa, len, needle, 6); });
+            double h = time_op(len, [&]() { return size_t(bytes_hash(pa, len)); });
+
+            printf("%-8s %7zu %6.1f %7.1f %7.1f %7.1f %7.1f %7.1f\n", names[level], len, eq, cmp, fc, rfc, fs, h);
+
+            for (size_t i = 0; i < len; ++i)
+                a[i] = b[i] = char('a' + i % 23);
+        }
+    }
+}
+
+#endif // BENCHMARK
+
+#endif // SIMD_CPP
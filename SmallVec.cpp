@@ -0,0 +1,585 @@
+// 大多数Vec只存放很少的元素，SmallVec在对象内部预留N个元素的空间
+// 元素个数不超过N时不分配堆内存，超过N之后才像Vec一样把元素搬到堆上
+// 接口和Vec保持一致，begin/end仍然是裸指针，因此遍历的代码不需要区分两种存储方式
+
+#ifndef SMALLVEC_CPP
+#define SMALLVEC_CPP
+
+#pragma push_macro("NO_MAIN") //只引入实现，不引入它们的测试代码；保存外层的定义，以便本文件也能被嵌套include
+#define NO_MAIN
+#include "Vec.cpp"
+#pragma pop_macro("NO_MAIN")
+#include <crtdbg.h>
+#include <assert.h>
+
+using namespace std;
+
+#ifndef BENCHMARK
+#define DEBUG
+#endif
+
+template<typename T, size_t N, typename Growth = DoubleGrowth>
+class SmallVec
+{
+public:
+    typedef T* iterator;
+    typedef const T* const_iterator;
+    typedef size_t size_type;
+    typedef T& ref;
+    typedef const T& const_ref;
+
+private:
+    iterator base;
+    iterator limit;
+    iterator avail;
+
+    // 内嵌的缓冲区，只是一块对齐的原始内存，元素仍然需要用construct构造
+    typename aligned_storage<sizeof(T) * N, alignof(T)>::type buffer;
+    allocator<T> alloc;
+    typedef allocator_traits<allocator<T> > alloc_traits;
+
+public:
+    SmallVec(): base(inline_base()), limit(inline_base() + N), avail(inline_base()) {}
+    explicit SmallVec(size_type n, const_ref val = T());
+    SmallVec(const SmallVec& v);
+    SmallVec(SmallVec&& v) noexcept(is_nothrow_move_constructible<T>::value);
+    SmallVec& operator=(const SmallVec& v);
+    SmallVec& operator=(SmallVec&& v) noexcept(is_nothrow_move_constructible<T>::value);
+    ~SmallVec();
+
+    bool empty() const { return base == avail;}
+    bool is_inline() const { return base == inline_base(); } //元素是否还存放在对象内部
+    iterator begin() { return base; }
+    const_iterator begin() const { return base; }
+    iterator end() { return avail; }
+    const_iterator end() const { return avail; }
+    size_type size() const { return avail - base; }
+    size_type capacity() const { return limit - base; }
+    size_type max_size() const { return numeric_limits<size_type>::max() / sizeof(T); }
+    const_ref front() const { return *base; }
+    const_ref back() const { return *(avail- 1); }
+
+    void push_back(const_ref val) { emplace_back(val); }
+    void push_back(T&& val) { emplace_back(std::move(val)); }
+    template<typename... Args>
+    void emplace_back(Args&&... args);
+    void clear();
+    void reserve(size_type n);
+    void shrink_to_fit();
+    void resize(size_type n);
+    void resize(size_type n, const_ref val);
+    iterator insert(iterator pos, const_ref val) { return emplace(pos, val); }
+    iterator insert(iterator pos, T&& val) { return emplace(pos, std::move(val)); }
+    template<typename... Args>
+    iterator emplace(iterator pos, Args&&... args);
+    template<typename In>
+    iterator insert(iterator pos, In first, In last);
+    iterator erase(iterator pos) { return erase(pos, pos + 1); }
+    iterator erase(iterator first, iterator last);
+    ref at(size_type n);
+
+    ref operator[](size_type n) {return base[n]; }
+    const_ref operator[](size_type n) const { return base[n]; }
+    bool operator==(const SmallVec& v) const;
+
+private:
+    iterator inline_base() { return reinterpret_cast<iterator>(&buffer); }
+    const_iterator inline_base() const { return reinterpret_cast<const_iterator>(&buffer); }
+
+    void del();
+    void grow(size_type required);
+    void reallocate(size_type new_size);
+    void steal(SmallVec& v);
+
+    iterator relocate(iterator first, iterator last, iterator dest, true_type);
+    iterator relocate(iterator first, iterator last, iterator dest, false_type);
+    void destroy(iterator first, iterator last);
+};
+
+
+
+/* 公有成员函数的实现 */
+
+template<typename T, size_t N, typename Growth>
+SmallVec<T, N, Growth>::SmallVec(size_type n, const_ref val): base(inline_base()), limit(inline_base() + N), avail(inline_base())
+{
+    reserve(n);
+    uninitialized_fill(base, base + n, val);
+    avail = base + n;
+}
+
+
+template<typename T, size_t N, typename Growth>
+SmallVec<T, N, Growth>::SmallVec(const SmallVec& v): base(inline_base()), limit(inline_base() + N), avail(inline_base())
+{
+    reserve(v.size());
+    avail = uninitialized_copy(v.begin(), v.end(), base);
+}
+
+
+template<typename T, size_t N, typename Growth>
+SmallVec<T, N, Growth>::SmallVec(SmallVec&& v) noexcept(is_nothrow_move_constructible<T>::value)
+    : base(inline_base()), limit(inline_base() + N), avail(inline_base())
+{
+    steal(v);
+}
+
+
+template<typename T, size_t N, typename Growth>
+SmallVec<T, N, Growth>& SmallVec<T, N, Growth>::operator=(const SmallVec& v)
+{
+    if (&v != this)
+    {
+        clear();
+        reserve(v.size());
+        avail = uninitialized_copy(v.begin(), v.end(), base);
+    }
+
+    return *this;
+}
+
+
+template<typename T, size_t N, typename Growth>
+SmallVec<T, N, Growth>& SmallVec<T, N, Growth>::operator=(SmallVec&& v) noexcept(is_nothrow_move_constructible<T>::value)
+{
+    if (&v != this)
+    {
+        del();
+        steal(v);
+    }
+
+    return *this;
+}
+
+
+template<typename T, size_t N, typename Growth>
+SmallVec<T, N, Growth>::~SmallVec()
+{
+    del();
+}
+
+
+template<typename T, size_t N, typename Growth>
+template<typename... Args>
+void SmallVec<T, N, Growth>::emplace_back(Args&&... args)
+{
+    if (avail + 1 > limit)
+    {
+        T temp(std::forward<Args>(args)...); // args可能引用本容器中的元素
+        grow(size() + 1);
+        alloc_traits::construct(alloc, avail++, std::move(temp));
+        return;
+    }
+
+    alloc_traits::construct(alloc, avail++, std::forward<Args>(args)...);
+}
+
+
+template<typename T, size_t N, typename Growth>
+void SmallVec<T, N, Growth>::clear()
+{
+    destroy(base, avail);
+    avail = base;
+}
+
+
+template<typename T, size_t N, typename Growth>
+void SmallVec<T, N, Growth>::reserve(size_type n)
+{
+    if (n > max_size())
+        throw "SmallVec too long";
+
+    if (n > capacity())
+        reallocate(n);
+}
+
+
+// 元素个数不超过N时搬回内嵌缓冲区并释放堆内存
+template<typename T, size_t N, typename Growth>
+void SmallVec<T, N, Growth>::shrink_to_fit()
+{
+    if (is_inline() || avail == limit)
+        return;
+
+    reallocate(size());
+}
+
+
+template<typename T, size_t N, typename Growth>
+void SmallVec<T, N, Growth>::resize(size_type n)
+{
+    if (n <= size())
+    {
+        destroy(base + n, avail);
+        avail = base + n;
+        return;
+    }
+
+    if (n > capacity())
+        grow(n);
+
+    for (; avail != base + n; ++avail)
+        alloc_traits::construct(alloc, avail);
+}
+
+
+template<typename T, size_t N, typename Growth>
+void SmallVec<T, N, Growth>::resize(size_type n, const_ref val)
+{
+    if (n <= size())
+    {
+        destroy(base + n, avail);
+        avail = base + n;
+        return;
+    }
+
+    T temp(val); // val可能是本容器中的元素
+    if (n > capacity())
+        grow(n);
+
+    uninitialized_fill(avail, base + n, temp);
+    avail = base + n;
+}
+
+
+template<typename T, size_t N, typename Growth>
+template<typename... Args>
+typename SmallVec<T, N, Growth>::iterator SmallVec<T, N, Growth>::emplace(iterator pos, Args&&... args)
+{
+    if (pos > avail || pos < base)
+        throw "illegal input iterator";
+
+    size_type offset = pos - base;
+
+    if (pos == avail)
+    {
+        emplace_back(std::forward<Args>(args)...);
+        return base + offset;
+    }
+
+    T temp(std::forward<Args>(args)...);
+
+    if (avail + 1 > limit)
+    {
+        grow(size() + 1);
+        pos = base + offset;
+    }
+
+    // 对平凡可拷贝的类型，move_backward会被编译成一次memmove
+    alloc_traits::construct(alloc, avail, std::move(*(avail - 1)));
+    move_backward(pos, avail - 1, avail);
+    ++avail;
+
+    *pos = std::move(temp);
+    return pos;
+}
+
+
+template<typename T, size_t N, typename Growth>
+template<typename In>
+typename SmallVec<T, N, Growth>::iterator SmallVec<T, N, Growth>::insert(iterator pos, In first, In last)
+{
+    if (pos > avail || pos < base || last < first)
+        throw "illegal input iterator";
+
+    if (first == last)
+        return pos;
+
+    size_type add = last - first;
+    if (add > capacity() - size())
+    {
+        size_type offset = pos - base;
+        grow(size() + add);
+        pos = base + offset;
+    }
+
+    // 和Vec一样分类讨论：尾部有一部分元素要移动到未初始化的内存上
+    size_type remains = avail - pos;
+    if (remains > add)
+    {
+        uninitialized_copy(make_move_iterator(avail - add), make_move_iterator(avail), avail);
+        move_backward(pos, avail - add, avail);
+        copy(first, last, pos);
+    }
+    else
+    {
+        uninitialized_copy(make_move_iterator(pos), make_move_iterator(avail), avail + add - remains);
+        copy(first, first + remains, pos);
+        uninitialized_copy(first + remains, last, avail);
+    }
+
+    avail += add;
+    return pos;
+}
+
+
+template<typename T, size_t N, typename Growth>
+typename SmallVec<T, N, Growth>::iterator SmallVec<T, N, Growth>::erase(iterator first, iterator last)
+{
+    if (!(first >= base && first <= last && last <= avail))
+        throw "illegal input iterator";
+
+    iterator new_avail = std::move(last, avail, first);
+    destroy(new_avail, avail);
+    avail = new_avail;
+
+    return first;
+}
+
+
+template<typename T, size_t N, typename Growth>
+typename SmallVec<T, N, Growth>::ref SmallVec<T, N, Growth>::at(size_type n)
+{
+    if(base + n >= avail)
+        throw "illegal position";
+
+    return base[n];
+}
+
+
+template<typename T, size_t N, typename Growth>
+bool SmallVec<T, N, Growth>::operator==(const SmallVec& v) const
+{
+    return size() == v.size() && equal(begin(), end(), v.begin());
+}
+
+
+
+/* 私有成员函数的实现 */
+
+// 析构所有元素，如果在堆上则释放内存，之后回到内嵌缓冲区
+template<typename T, size_t N, typename Growth>
+void SmallVec<T, N, Growth>::del()
+{
+    destroy(base, avail);
+    if (!is_inline())
+        alloc_traits::deallocate(alloc, base, limit - base);
+
+    base = avail = inline_base();
+    limit = inline_base() + N;
+}
+
+
+template<typename T, size_t N, typename Growth>
+void SmallVec<T, N, Growth>::grow(size_type required)
+{
+    if (required > max_size())
+        throw "SmallVec too long";
+
+    reallocate(min(Growth::next(capacity(), required, sizeof(T)), max_size()));
+}
+
+
+// new_size不超过N时搬回内嵌缓冲区，否则搬到新分配的堆内存
+template<typename T, size_t N, typename Growth>
+void SmallVec<T, N, Growth>::reallocate(size_type new_size)
+{
+    bool to_inline = new_size <= N;
+    if (to_inline && is_inline())
+        return;
+
+    iterator new_base = to_inline ? inline_base() : alloc_traits::allocate(alloc, new_size);
+    iterator new_avail;
+
+    try
+    {
+        new_avail = relocate(base, avail, new_base, typename trivially_relocatable<T>::type());
+    }
+    catch(...)
+    {
+        if (!to_inline)
+            alloc_traits::deallocate(alloc, new_base, new_size);
+        throw;
+    }
+
+    if (!is_inline())
+        alloc_traits::deallocate(alloc, base, limit - base);
+
+    base = new_base;
+    avail = new_avail;
+    limit = to_inline ? inline_base() + N : new_base + new_size;
+}
+
+
+// 调用前本对象不含元素且处于内嵌状态
+// v在堆上时直接接管v的内存；在内嵌缓冲区时只能逐个移动元素
+template<typename T, size_t N, typename Growth>
+void SmallVec<T, N, Growth>::steal(SmallVec& v)
+{
+    if (v.is_inline())
+    {
+        avail = uninitialized_copy(make_move_iterator(v.begin()), make_move_iterator(v.end()), base);
+        v.clear();
+        return;
+    }
+
+    base = v.base;
+    limit = v.limit;
+    avail = v.avail;
+    v.base = v.avail = v.inline_base();
+    v.limit = v.inline_base() + N;
+}
+
+
+template<typename T, size_t N, typename Growth>
+typename SmallVec<T, N, Growth>::iterator SmallVec<T, N, Growth>::relocate(iterator first, iterator last, iterator dest, true_type)
+{
+    if (first != last)
+        memcpy(static_cast<void*>(dest), static_cast<const void*>(first), (last - first) * sizeof(T));
+
+    return dest + (last - first);
+}
+
+
+template<typename T, size_t N, typename Growth>
+typename SmallVec<T, N, Growth>::iterator SmallVec<T, N, Growth>::relocate(iterator first, iterator last, iterator dest, false_type)
+{
+    iterator cur = dest;
+    try
+    {
+        for (iterator it = first; it != last; ++it, ++cur)
+            alloc_traits::construct(alloc, cur, std::move_if_noexcept(*it));
+    }
+    catch(...)
+    {
+        destroy(dest, cur);
+        throw;
+    }
+
+    destroy(first, last);
+    return cur;
+}
+
+
+template<typename T, size_t N, typename Growth>
+void SmallVec<T, N, Growth>::destroy(iterator first, iterator last)
+{
+    if (is_trivially_destructible<T>::value) //编译期常量，平凡析构的类型整个循环会被优化掉
+        return;
+
+    while (last != first)
+        alloc_traits::destroy(alloc, --last);
+}
+
+
+
+/* 测试代码 */
+
+#if defined(DEBUG) && !defined(NO_MAIN)
+
+int main(int argc, char* argv[])
+{
+    {
+        SmallVec<int, 4> v1;
+        assert(v1.is_inline() && v1.capacity() == 4);
+        for (int i = 0; i < 4; ++i)
+            v1.push_back(i);
+        assert(v1.is_inline() && v1.size() == 4);
+        v1.push_back(4); //超过N，搬到堆上
+        assert(!v1.is_inline() && v1.size() == 5 && v1[4] == 4);
+        v1.erase(v1.begin() + 1, v1.begin() + 3);
+        assert(v1.size() == 3 && v1[1] == 3);
+        v1.shrink_to_fit(); //元素个数不超过N，回到内嵌缓冲区
+        assert(v1.is_inline() && v1[0] == 0 && v1[2] == 4);
+        int a[] = {7, 8, 9};
+        v1.insert(v1.begin() + 1, a, a + 3);
+        assert(v1.size() == 6 && v1[1] == 7 && v1[3] == 9 && v1[4] == 3);
+        assert(v1.at(5) == 4);
+
+        SmallVec<string, 2> v2;
+        v2.emplace_back(3, 'a');
+        v2.push_back("bb");
+        SmallVec<string, 2> v3(std::move(v2)); //内嵌状态下只能逐个移动元素
+        assert(v2.empty() && v3.size() == 2 && v3[0] == "aaa");
+        v3.emplace(v3.begin(), "c");
+        v3.push_back(v3[0]);
+        SmallVec<string, 2> v4(v3);
+        assert(v4 == v3 && !v4.is_inline());
+        SmallVec<string, 2> v5(std::move(v3)); //在堆上时直接接管内存
+        assert(v3.empty() && v3.is_inline() && v5.size() == 4 && v5[3] == "c");
+        v5.resize(1);
+        v5.resize(3, "d");
+        assert(v5.size() == 3 && v5[0] == "c" && v5[2] == "d");
+        v4 = v5;
+        assert(v4 == v5);
+        v5 = SmallVec<string, 2>(1, "e");
+        assert(v5.size() == 1 && v5.back() == "e");
+
+        Vec<SmallVec<int, 4> > v6;
+        for (int i = 0; i < 10; ++i)
+            v6.push_back(SmallVec<int, 4>(i, i));
+        assert(v6[9].size() == 9 && v6[9][8] == 9 && v6[3].is_inline());
+    }
+
+    _CrtDumpMemoryLeaks();
+}
+
+#endif // DEBUG
+
+
+/* 性能测试代码 */
+
+#if defined(BENCHMARK) && !defined(NO_MAIN)
+
+#include <chrono>
+#include <cstdlib>
+#include <new>
+
+static size_t alloc_count = 0;
+
+void* operator new(size_t n)
+{
+    ++alloc_count;
+    if (void* p = malloc(n))
+        return p;
+    throw bad_alloc();
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+
+// 构造大量只有几个元素的小容器，然后遍历求和
+// 内嵌存储的元素和容器本身在同一块连续内存里，遍历时不需要再跳到各自的堆内存上
+// 缓存缺失的差异可以用 perf stat -e cache-misses 观察
+template<typename V>
+void bench_small(const char* name, size_t n)
+{
+    alloc_count = 0;
+    auto start = chrono::steady_clock::now();
+
+    Vec<V> all;
+    all.reserve(n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        V v;
+        for (size_t j = 0; j < 1 + i % 8; ++j)
+            v.push_back(int(i + j));
+        all.push_back(std::move(v));
+    }
+    double build = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    size_t allocs = alloc_count;
+
+    start = chrono::steady_clock::now();
+    long long sum = 0;
+    for (int round = 0; round < 10; ++round)
+        for (size_t i = 0; i < all.size(); ++i)
+            for (auto it = all[i].begin(); it != all[i].end(); ++it)
+                sum += *it;
+    double scan = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    cout << name << ": " << allocs << " allocations, build " << build << " ms, 10 scans " << scan << " ms (" << sum << ")" << endl;
+}
+
+
+int main(int argc, char* argv[])
+{
+    size_t n = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000000;
+
+    bench_small<Vec<int> >("Vec<int>", n);
+    bench_small<SmallVec<int, 8> >("SmallVec<int, 8>", n);
+}
+
+#endif // BENCHMARK
+
+#endif // SMALLVEC_CPP
@@ -1,187 +1,1477 @@
-// 这里的实现不是标准库中的实现，标准库中的成员变量应该是一个char* 指针和长度变量
-
-#include "Vec.cpp"
-#include "sharedPtr.cpp"
-#include <ctype.h>
-#include <cstring>
-#include <crtdbg.h>
-#include <assert.h>
-
-using namespace std;
-
-#define DEBUG
-
-class Str
-{
-public:
-    typedef Vec<char>::size_type size_type;
-    typedef char& ref;
-    typedef const char& const_ref;
-    typedef Vec<char>::iterator iter;
-    typedef Vec<char>::const_iterator const_iter;
-
-friend  istream& operator>>(istream& is, Str& s);
-private:
-    Vec<char> string;
-    char* pt;
-
-public:
-    Str(): pt(nullptr) {}
-    Str(size_type n, char c): string(n,c), pt(nullptr) {}
-    Str(const char* cp): pt(nullptr) { string.insert(string.end(), cp, cp +strlen(cp));}
-    template<typename In>
-    Str(In begin, In end): pt(nullptr) { string.insert(string.end(), begin, end);}
-
-    ref at(size_type n);
-    bool empty() const {return string.empty();}
-    size_type size() const { return string.size();}
-    const char* c_str() {renew_pt(); return pt;}; //返回的是一个临时指针
-    iter begin() { return string.begin();}
-    const_iter begin() const { return string.begin();} // 如果不加const后缀则无法重载，因为参数是一样的
-    iter end() { return string.end();}
-    const_iter end() const { return string.end();}
-
-    void clear() { string.clear(); pt = nullptr; }
-    void push_back(const char c) { string.push_back(c);}
-    void copy_to(char* dest) { copy(string.begin(), string.end(), dest);}
-
-    ref operator[](size_type n) {return string[n];}
-    const_ref operator[](size_type n) const { return string[n]; }
-    Str& operator+=(const Str& s);
-    bool operator==(const Str& s);
-    operator const char*() {renew_pt(); return pt; }
-    operator bool() { return !string.empty();}
-private:
-    void renew_pt();
-};
-
-/*相关操作的函数*/
-// is >> s 等价于 is.operator>>(s),是is被重载的运算符，因此只能用友元函数形式实现
-// 如果用成员函数实现，则操作形式为s.operator>>(cin),等价于s>>cin，与习惯操作不同
-istream& operator>>(istream& is, Str& s)
-{
-    s.clear();
-
-    char c;
-    while(is.get(c) && isspace(c))
-        ;
-
-    if(is)
-    {
-        do
-        {
-            s.push_back(c);
-        } while (is.get(c) && !isspace(c));
-    }
-
-    return is;
-}
-
-
-ostream& operator<<(ostream& os, const Str& s)
-{
-    for(size_t i = 0; i < s.size(); ++i)
-        os << s[i];
-
-    return os;
-}
-
-// 由于加号的左边可能不是string类，此时我们仍要支持加法操作，因此只能通过非成员函数实现
-// 如果连续多个加号，则此方法需要生成许多临时变量，效率很低，因此这种的string是用别的很繁琐的方式实现的
-Str operator+(const Str& left, const Str& right)//通过隐式构造函数可以由const char* 转换成Str类型
-{
-    Str result = left;
-    result += right;
-    return result;
-}
-
-
-/* 公有成员函数的实现 */
-
-
-Str::ref Str::at(size_type n)
-{
-    if(string.begin() + n >= string.end())
-        throw "illegal position";
-
-    return string[n];
-}
-
-
-Str& Str::operator+=(const Str& s)
-{
-    string.insert(string.end(), s.string.begin(), s.string.end());
-    //copy(s.string.begin(), s.string.end(), back_inserter(string));
-    return *this;
-}
-
-
-bool Str::operator==(const Str& s)
-{
-    if (&s == this)
-        return true;
-
-    if (size() != s.size())
-        return false;
-
-    for(size_t i = 0; i < size(); ++i)
-    {
-        if(string[i] != s[i])
-            return false;
-    }
-
-    return true;
-}
-
-
-/* 私有成员函数的实现 */
-
-void Str::renew_pt()
-{
-    size_type len = string.size();
-    if (pt != nullptr)
-        delete pt;
-
-    pt = new char(len + 1);
-    copy(string.begin(), string.end(), pt);
-    pt[len] = '\0';
-}
-
-
-
-/* 测试代码 */
-
-#ifdef DEBUG
-
-int main(int argc, char* argv[])
-{
-	{
-        Str str1(5, 'c');
-        Str str2 = "abcdefg";
-        Str str3(str2.begin(), str2.end());
-        assert(str1.size() == 5);
-        assert(str3.size() == 7);
-        assert(strcmp(str2.c_str(), "abcdefg") == 0);
-        str1.clear();
-        assert(str1.empty());
-        str1.push_back('d');
-        char dest[100];
-        str2.copy_to(dest);
-        assert(strcmp(dest, "abcdefg") == 0);
-        str3[0] = 'h';
-        assert(strcmp(str3.c_str(), "hbcdefg") == 0);
-        str2 += "123";
-        assert(strcmp(str2.c_str(), "abcdefg123") == 0);
-        assert(str2 == str2);
-        cout << str2;
-        assert(str1 == str1);
-	}
-
-	_CrtDumpMemoryLeaks();
-	//由于该检测手法实在main函数推出前检测，而此时各个类实例还没出作用域
-	//所以一直会存在内存泄漏，解决方法就是多加一层括号
-}
-
-#endif // DEBUG
-
-
+// 这里的实现和标准库类似，成员变量是一个char* 指针和长度变量，短字符串则直接存放在对象内部
+
+#ifndef STR_CPP
+#define STR_CPP
+
+#pragma push_macro("NO_MAIN") //只引入实现，不引入它们的测试代码；保存外层的定义，以便本文件也能被嵌套include
+#define NO_MAIN
+#include "Vec.cpp"
+#include "sharedPtr.cpp"
+#include "StrView.cpp"
+#pragma pop_macro("NO_MAIN")
+#include <ctype.h>
+#include <cstring>
+#include <crtdbg.h>
+#include <assert.h>
+
+using namespace std;
+
+#ifndef BENCHMARK
+#define DEBUG
+#endif
+
+template<typename L, typename R>
+class StrCat;
+
+class Str
+{
+public:
+    typedef size_t size_type;
+    typedef char& ref;
+    typedef const char& const_ref;
+    typedef char* iter;
+    typedef const char* const_iter;
+    static const size_type npos = BYTES_NPOS; //find/rfind查找失败时的返回值
+
+friend  istream& operator>>(istream& is, Str& s);
+private:
+    // 不超过SMALL_CAP个字符的短字符串直接存放在对象内部，不分配堆内存
+    // 长字符串存放在堆上，容量记录在堆内存块的头部，所以对象本身只需要一个指针和一个长度
+    // 两种情况下字符串末尾都始终保持'\0'，c_str()直接返回数据指针，不需要额外分配内存
+    enum { SMALL_CAP = 22, HEAP_FLAG = 0xFF };
+
+    struct Heap
+    {
+        char* ptr;
+        size_type size;
+    };
+
+    union
+    {
+        Heap heap;
+        char small[SMALL_CAP + 2]; //SMALL_CAP个字符和'\0'，最后一个字节记录短字符串的长度，存放在堆上时为HEAP_FLAG
+    };
+
+public:
+    Str() { init(0); }
+    Str(size_type n, char c) { init(n); memset(data(), c, n); }
+    Str(const char* cp) { size_type n = strlen(cp); init(n); memcpy(data(), cp, n); }
+    template<typename In>
+    Str(In begin, In end) { init(end - begin); copy(begin, end, data()); }
+    Str(const Str& s) { init(s.size()); memcpy(data(), s.data(), s.size()); }
+    Str(Str&& s) noexcept { steal(s); }
+    explicit Str(StrView v) { init(v.size()); memcpy(data(), v.data(), v.size()); } //从视图得到一个独立的副本，需要显式转换，避免无意中的拷贝
+    template<typename L, typename R>
+    Str(const StrCat<L, R>& e) { init(e.size()); e.write(data()); } //先算出总长度，只分配一次
+    Str& operator=(const Str& s);
+    Str& operator=(Str&& s) noexcept;
+    Str& operator=(const char* cp) { return assign(cp, strlen(cp)); }
+    template<typename L, typename R>
+    Str& operator=(const StrCat<L, R>& e) { Str temp(e); swap(temp); return *this; } //e可能引用了本对象的内容，不能直接在原处写入
+    ~Str() { release(); }
+
+    ref at(size_type n);
+    bool empty() const {return size() == 0;}
+    size_type size() const { return is_small() ? small[SMALL_CAP + 1] : heap.size; }
+    size_type capacity() const { return is_small() ? size_type(SMALL_CAP) : heap_capacity(); }
+    char* data() { return is_small() ? small : heap.ptr; }
+    const char* data() const { return is_small() ? small : heap.ptr; }
+    const char* c_str() const { return data(); } //数据本身以'\0'结尾，返回的指针在下一次修改前一直有效
+    iter begin() { return data();}
+    const_iter begin() const { return data();} // 如果不加const后缀则无法重载，因为参数是一样的
+    iter end() { return data() + size();}
+    const_iter end() const { return data() + size();}
+
+    void clear() { set_size(0); } //保留已有的容量
+    void reserve(size_type n);
+    void push_back(const char c);
+    Str& assign(const char* cp, size_type n);
+    Str& append(const char* cp, size_type n);
+    Str& append(const char* cp) { return append(cp, strlen(cp)); }
+    Str& append(const Str& s) { return append(s.data(), s.size()); }
+    Str& append(StrView v) { return append(v.data(), v.size()); }
+    void copy_to(char* dest) const { memcpy(dest, data(), size());}
+    void swap(Str& s) noexcept;
+    StrView substr(size_type pos, size_type n = npos) const { return StrView(*this).substr(pos, n); } //不拷贝，返回的视图在本对象修改前有效
+
+    // 比较和查找都交给Simd.cpp中按CPU指令集分派的向量化实现
+    int compare(const Str& s) const;
+    size_type find(char c, size_type pos = 0) const;
+    size_type find(const char* cp, size_type pos, size_type n) const;
+    size_type find(const char* cp, size_type pos = 0) const { return find(cp, pos, strlen(cp)); }
+    size_type find(const Str& s, size_type pos = 0) const { return find(s.data(), pos, s.size()); }
+    size_type rfind(char c, size_type pos = npos) const;
+    size_type rfind(const char* cp, size_type pos, size_type n) const;
+    size_type rfind(const char* cp, size_type pos = npos) const { return rfind(cp, pos, strlen(cp)); }
+    size_type rfind(const Str& s, size_type pos = npos) const { return rfind(s.data(), pos, s.size()); }
+    size_t hash() const { return size_t(bytes_hash(data(), size())); }
+
+    ref operator[](size_type n) {return data()[n];}
+    const_ref operator[](size_type n) const { return data()[n]; }
+    Str& operator+=(const Str& s) { return append(s.data(), s.size()); }
+    Str& operator+=(const char* cp) { return append(cp, strlen(cp)); }
+    Str& operator+=(char c) { push_back(c); return *this; }
+    Str& operator+=(StrView v) { return append(v.data(), v.size()); }
+    template<typename L, typename R>
+    Str& operator+=(const StrCat<L, R>& e);
+    bool operator==(const Str& s) const;
+    bool operator!=(const Str& s) const { return !(*this == s); }
+    bool operator<(const Str& s) const { return compare(s) < 0; }
+    bool operator<=(const Str& s) const { return compare(s) <= 0; }
+    bool operator>(const Str& s) const { return compare(s) > 0; }
+    bool operator>=(const Str& s) const { return compare(s) >= 0; }
+    operator const char*() const { return data(); }
+    operator bool() const { return !empty();}
+private:
+    bool is_small() const { return static_cast<unsigned char>(small[SMALL_CAP + 1]) != HEAP_FLAG; }
+    size_type heap_capacity() const { return reinterpret_cast<const size_type*>(heap.ptr)[-1]; }
+    void init(size_type n);
+    void set_size(size_type n);
+    void steal(Str& s);
+    void release();
+    static char* allocate(size_type cap);
+    static void deallocate(char* p) { ::operator delete(reinterpret_cast<size_type*>(p) - 1); }
+};
+
+// Str只保存一个堆指针或内嵌的字符，没有指向自身的指针，可以整块搬运，Vec<Str>在grow/insert/erase时直接memcpy
+template<>
+struct trivially_relocatable<Str> : true_type {};
+
+const Str::size_type Str::npos;
+
+inline StrView::StrView(const Str& s): ptr(s.data()), len(s.size()) {}
+
+// 可以直接作为unordered_map等容器的键
+namespace std
+{
+    template<>
+    struct hash<Str>
+    {
+        size_t operator()(const Str& s) const { return s.hash(); }
+    };
+}
+
+
+/*相关操作的函数*/
+
+// streambuf的gptr/egptr/gbump是protected成员，通过派生类取得成员函数指针后，可以作用于任何streambuf对象
+struct GetArea : streambuf
+{
+    static const char* begin(streambuf* sb) { return (sb->*(&GetArea::gptr))(); } //下一个要读取的字符
+    static const char* end(streambuf* sb) { return (sb->*(&GetArea::egptr))(); }
+    static void consume(streambuf* sb, size_t n) { (sb->*(&GetArea::gbump))(int(n)); } //n不超过get区的长度
+};
+
+// is >> s 等价于 is.operator>>(s),是is被重载的运算符，因此只能用友元函数形式实现
+// 如果用成员函数实现，则操作形式为s.operator>>(cin),等价于s>>cin，与习惯操作不同
+// 直接在streambuf的get区（缓冲区中尚未读取的部分）里查找空白，整段追加，再一次性移动读取位置
+// 缓冲区为空时sgetc()会调用underflow()重新填充；没有缓冲区的streambuf（如与stdio同步的cin）退回到逐字符读取
+istream& operator>>(istream& is, Str& s)
+{
+    istream::sentry ok(is, true); //空白由下面成块跳过，不让sentry逐个字符跳过
+    if (!ok)
+        return is;
+
+    s.clear();
+    streambuf* sb = is.rdbuf();
+    ios_base::iostate state = ios_base::goodbit;
+    bool in_word = false;
+
+    for (;;)
+    {
+        int c = sb->sgetc();
+        if (c == char_traits<char>::eof())
+        {
+            state |= ios_base::eofbit;
+            break;
+        }
+
+        const char* p = GetArea::begin(sb);
+        size_t n = GetArea::end(sb) - p;
+        if (n == 0)
+        {
+            if (is_space_byte(char(c)))
+            {
+                if (in_word)
+                    break;
+            }
+            else
+            {
+                in_word = true;
+                s.push_back(char(c));
+            }
+            sb->sbumpc();
+            continue;
+        }
+
+        if (!in_word)
+        {
+            size_t k = bytes_find_nonspace(p, n);
+            if (k == BYTES_NPOS)
+            {
+                GetArea::consume(sb, n);
+                continue;
+            }
+            GetArea::consume(sb, k);
+            p += k;
+            n -= k;
+            in_word = true;
+        }
+
+        size_t k = bytes_find_space(p, n);
+        size_t len = k == BYTES_NPOS ? n : k;
+        s.append(p, len);
+        GetArea::consume(sb, len);
+        if (k != BYTES_NPOS)
+            break; //单词后面的空白留在流中，与标准库一致
+    }
+
+    if (!in_word)
+        state |= ios_base::failbit;
+    is.setstate(state);
+    return is;
+}
+
+
+// 读取一行，不包括末尾的delim；与std::getline相同，什么都没有读到时设置failbit
+istream& getline(istream& is, Str& s, char delim = '\n')
+{
+    istream::sentry ok(is, true);
+    if (!ok)
+        return is;
+
+    s.clear();
+    streambuf* sb = is.rdbuf();
+    ios_base::iostate state = ios_base::goodbit;
+    bool extracted = false;
+
+    for (;;)
+    {
+        int c = sb->sgetc();
+        if (c == char_traits<char>::eof())
+        {
+            state |= ios_base::eofbit;
+            break;
+        }
+
+        extracted = true;
+        const char* p = GetArea::begin(sb);
+        size_t n = GetArea::end(sb) - p;
+        if (n == 0)
+        {
+            sb->sbumpc();
+            if (char(c) == delim)
+                break;
+            s.push_back(char(c));
+            continue;
+        }
+
+        size_t k = bytes_find_char(p, n, delim);
+        size_t len = k == BYTES_NPOS ? n : k;
+        s.append(p, len);
+        if (k != BYTES_NPOS)
+        {
+            GetArea::consume(sb, len + 1); //连同delim一起取走
+            break;
+        }
+        GetArea::consume(sb, len);
+    }
+
+    if (!extracted)
+        state |= ios_base::failbit;
+    is.setstate(state);
+    return is;
+}
+
+
+ostream& operator<<(ostream& os, const Str& s)
+{
+    os.write(s.data(), s.size()); //整块写入，而不是逐个字符调用operator<<
+    return os;
+}
+
+
+/* 连接表达式 */
+
+// 如果operator+直接返回Str，那么a + b + c + d会为每个加号生成一个临时Str，并反复分配内存
+// 这里operator+只返回一个记录了各个部分的表达式对象StrCat，不做任何拷贝
+// 赋值给Str时先算出总长度，一次分配内存，再依次把各部分写入
+// 表达式只引用了各个部分的内容，因此必须在同一个完整表达式中使用，不能用auto保存下来
+
+// 一段连续的字符，Str和const char*都转换为这种形式
+class StrPiece
+{
+public:
+    StrPiece(const char* p, size_t n): ptr(p), len(n) {}
+    size_t size() const { return len; }
+    char* write(char* dest) const { memcpy(dest, ptr, len); return dest + len; }
+private:
+    const char* ptr;
+    size_t len;
+};
+
+
+// 单个字符按值保存
+class CharPiece
+{
+public:
+    CharPiece(char ch): c(ch) {}
+    size_t size() const { return 1; }
+    char* write(char* dest) const { *dest = c; return dest + 1; }
+private:
+    char c;
+};
+
+
+template<typename L, typename R>
+class StrCat
+{
+public:
+    StrCat(const L& l, const R& r): left(l), right(r) {}
+    size_t size() const { return left.size() + right.size(); }
+    char* write(char* dest) const { return right.write(left.write(dest)); } //返回写入之后的位置
+    Str str() const { return Str(*this); }
+    // 和operator+直接返回Str时一样，(a + b).c_str()得到一个临时的Str，它在完整表达式结束前有效，可以隐式转换为const char*
+    Str c_str() const { return str(); }
+private:
+    L left;
+    R right;
+};
+
+
+// 描述哪些类型可以参与连接：is_str表示是否为Str或者连接表达式，get把它转换为表达式的一个部分
+// 至少一边is_str为true时operator+才生效，否则"abc" + 'c'这样的指针运算会被误匹配
+template<typename T>
+struct StrOperand
+{
+    static const bool is_str = false;
+};
+
+template<>
+struct StrOperand<Str>
+{
+    static const bool is_str = true;
+    typedef StrPiece piece;
+    static piece get(const Str& s) { return piece(s.data(), s.size()); }
+};
+
+template<>
+struct StrOperand<StrView>
+{
+    static const bool is_str = true;
+    typedef StrPiece piece;
+    static piece get(StrView s) { return piece(s.data(), s.size()); }
+};
+
+template<>
+struct StrOperand<const char*>
+{
+    static const bool is_str = false;
+    typedef StrPiece piece;
+    static piece get(const char* s) { return piece(s, strlen(s)); }
+};
+
+template<>
+struct StrOperand<char*> : StrOperand<const char*> {};
+
+template<>
+struct StrOperand<char>
+{
+    static const bool is_str = false;
+    typedef CharPiece piece;
+    static piece get(char c) { return piece(c); }
+};
+
+template<typename L, typename R>
+struct StrOperand<StrCat<L, R> >
+{
+    static const bool is_str = true;
+    typedef StrCat<L, R> piece;
+    static const piece& get(const piece& e) { return e; }
+};
+
+
+// 由于加号的左边可能不是string类，此时我们仍要支持加法操作，因此只能通过非成员函数实现
+// 字符串字面量的类型是char[N]，需要先decay成char*
+template<typename A, typename B>
+typename enable_if<StrOperand<typename decay<A>::type>::is_str || StrOperand<typename decay<B>::type>::is_str,
+                   StrCat<typename StrOperand<typename decay<A>::type>::piece, typename StrOperand<typename decay<B>::type>::piece> >::type
+operator+(const A& left, const B& right)
+{
+    typedef StrOperand<typename decay<A>::type> LeftOperand;
+    typedef StrOperand<typename decay<B>::type> RightOperand;
+    typedef StrCat<typename LeftOperand::piece, typename RightOperand::piece> Result;
+    return Result(LeftOperand::get(left), RightOperand::get(right));
+}
+
+
+// 容量足够时直接写到末尾，e引用的是[0, size())之间的内容，不会被覆盖
+template<typename L, typename R>
+Str& Str::operator+=(const StrCat<L, R>& e)
+{
+    size_type len = size(), add = e.size();
+    if (add > capacity() - len)
+    {
+        Str temp;
+        temp.reserve(DoubleGrowth::next(capacity(), len + add, 1));
+        memcpy(temp.data(), data(), len);
+        e.write(temp.data() + len);
+        temp.set_size(len + add);
+        swap(temp);
+        return *this;
+    }
+
+    e.write(data() + len);
+    set_size(len + add);
+    return *this;
+}
+
+// Str的比较运算是成员函数，左边不能是连接表达式，(a + b) == c需要这里的重载
+// 连接表达式先求值为Str，再和另一边一起按StrView比较，另一边可以是Str、StrView、const char*或者另一个连接表达式
+template<typename T>
+const T& cat_operand(const T& s) { return s; }
+
+template<typename L, typename R>
+Str cat_operand(const StrCat<L, R>& e) { return e.str(); }
+
+#define STR_CAT_COMPARE(op) \
+    template<typename L, typename R, typename B> \
+    bool operator op(const StrCat<L, R>& a, const B& b) { return StrView(cat_operand(a)) op StrView(cat_operand(b)); } \
+    template<typename A, typename L, typename R> \
+    bool operator op(const A& a, const StrCat<L, R>& b) { return StrView(cat_operand(a)) op StrView(cat_operand(b)); } \
+    template<typename L1, typename R1, typename L2, typename R2> \
+    bool operator op(const StrCat<L1, R1>& a, const StrCat<L2, R2>& b) { return StrView(a.str()) op StrView(b.str()); }
+
+STR_CAT_COMPARE(==)
+STR_CAT_COMPARE(!=)
+STR_CAT_COMPARE(<)
+STR_CAT_COMPARE(<=)
+STR_CAT_COMPARE(>)
+STR_CAT_COMPARE(>=)
+
+#undef STR_CAT_COMPARE
+
+
+/* StrBuilder */
+
+// 拼接日志等较长的内容时使用：预留好容量后不断追加，clear()保留容量，下一行可以复用同一块内存
+class StrBuilder
+{
+public:
+    typedef Str::size_type size_type;
+
+    explicit StrBuilder(size_type n = 0) { buf.reserve(n); }
+
+    StrBuilder& reserve(size_type n) { buf.reserve(n); return *this; }
+    StrBuilder& append(const char* cp, size_type n) { buf.append(cp, n); return *this; }
+    StrBuilder& append(const char* cp) { buf.append(cp); return *this; }
+    StrBuilder& append(const Str& s) { buf.append(s); return *this; }
+    StrBuilder& append(StrView v) { buf.append(v.data(), v.size()); return *this; } //子串、字段等不拥有字符的参数直接追加，不先拷贝成Str
+    StrBuilder& append(char c) { buf.push_back(c); return *this; }
+    StrBuilder& append(long long n);
+    StrBuilder& append(unsigned long long n);
+    StrBuilder& append(int n) { return append((long long)n); }
+    StrBuilder& append(long n) { return append((long long)n); }
+    StrBuilder& append(unsigned n) { return append((unsigned long long)n); }
+    StrBuilder& append(unsigned long n) { return append((unsigned long long)n); }
+    template<typename L, typename R>
+    StrBuilder& append(const StrCat<L, R>& e) { buf += e; return *this; }
+
+    template<typename T>
+    StrBuilder& operator<<(const T& val) { return append(val); }
+    StrBuilder& operator<<(StrView v) { return append(v); }
+
+    size_type size() const { return buf.size(); }
+    size_type capacity() const { return buf.capacity(); }
+    void clear() { buf.clear(); }
+    const Str& str() const { return buf; }
+    const char* c_str() const { return buf.c_str(); }
+    Str release() { Str result(std::move(buf)); return result; } //交出内容，之后builder为空
+
+private:
+    Str buf;
+};
+
+
+StrBuilder& StrBuilder::append(unsigned long long n)
+{
+    char digits[20]; //2^64 - 1 共20位
+    char* p = digits + sizeof(digits);
+    do
+    {
+        *--p = char('0' + n % 10);
+        n /= 10;
+    } while (n != 0);
+
+    return append(p, digits + sizeof(digits) - p);
+}
+
+
+StrBuilder& StrBuilder::append(long long n)
+{
+    if (n < 0)
+    {
+        buf.push_back('-');
+        return append(0ULL - (unsigned long long)n); //用无符号运算取反，避免最小值溢出
+    }
+
+    return append((unsigned long long)n);
+}
+
+
+/* 写时复制的字符串 */
+
+// 在流水线的各个阶段之间按值传递大字符串时使用：拷贝CowStr只增加引用计数，多个对象共享同一个不可变的Str
+// 修改之前先调用sharedPtr::make_unique，只有在被共享时才拷贝一份（通过clone），之后的修改只影响自己
+// 非const的operator[]、begin()、data()交出的引用可能在之后被写入，所以交出引用后本对象不再参与共享，拷贝它时总是深拷贝
+// 只读时应通过const引用访问，否则非const的operator[]也会触发拷贝
+class CowStr
+{
+public:
+    typedef Str::size_type size_type;
+    typedef Str::ref ref;
+    typedef Str::const_ref const_ref;
+    typedef Str::iter iter;
+    typedef Str::const_iter const_iter;
+    static const size_type npos = Str::npos;
+
+    CowStr(): leaked(false) {} //空字符串不分配内存
+    CowStr(const char* cp): handle(make_sharedPtr<Str>(cp)), leaked(false) {}
+    CowStr(const Str& s): handle(make_sharedPtr<Str>(s)), leaked(false) {}
+    CowStr(Str&& s): handle(make_sharedPtr<Str>(std::move(s))), leaked(false) {}
+    explicit CowStr(StrView v): handle(make_sharedPtr<Str>(v)), leaked(false) {}
+    CowStr(const CowStr& s): handle(s.share()), leaked(false) {}
+    CowStr(CowStr&& s) noexcept : handle(std::move(s.handle)), leaked(s.leaked) { s.leaked = false; }
+    CowStr& operator=(const CowStr& s);
+    CowStr& operator=(CowStr&& s) noexcept;
+
+    // 只读操作直接作用于共享的Str
+    const Str& str() const { return handle ? *handle.get() : empty_str(); }
+    operator StrView() const { return StrView(str()); }
+    bool empty() const { return size() == 0; }
+    size_type size() const { return str().size(); }
+    const char* data() const { return str().data(); }
+    const char* c_str() const { return str().c_str(); }
+    const_iter begin() const { return str().begin(); }
+    const_iter end() const { return str().end(); }
+    const_ref operator[](size_type n) const { return str()[n]; }
+    size_type find(char c, size_type pos = 0) const { return str().find(c, pos); }
+    size_type find(const char* cp, size_type pos = 0) const { return str().find(cp, pos); }
+    size_type rfind(char c, size_type pos = npos) const { return str().rfind(c, pos); }
+    StrView substr(size_type pos, size_type n = npos) const { return str().substr(pos, n); }
+    int compare(const CowStr& s) const { return str().compare(s.str()); }
+    size_t hash() const { return str().hash(); }
+    bool shared() const { return handle.use_count() > 1; } //是否与其他CowStr共享同一个缓冲区
+
+    // 修改操作先取得独占的副本
+    ref operator[](size_type n) { return mutable_str()[n]; }
+    iter begin() { return mutable_str().begin(); }
+    iter end() { return mutable_str().end(); }
+    char* data() { return mutable_str().data(); }
+    void clear();
+    void reserve(size_type n) { unshare().reserve(n); }
+    void push_back(char c) { unshare().push_back(c); }
+    CowStr& append(const char* cp, size_type n) { unshare().append(cp, n); return *this; }
+    CowStr& operator+=(const Str& s) { unshare().append(s); return *this; }
+    CowStr& operator+=(const CowStr& s);
+    CowStr& operator+=(const char* cp) { unshare().append(cp); return *this; }
+    CowStr& operator+=(char c) { unshare().push_back(c); return *this; }
+    CowStr& operator+=(StrView v) { unshare().append(v); return *this; }
+    void swap(CowStr& s) noexcept { handle.swap(s.handle); std::swap(leaked, s.leaked); }
+
+private:
+    sharedPtr<Str> share() const;
+    Str& unshare();
+    Str& mutable_str() { Str& s = unshare(); leaked = true; return s; }
+    static const Str& empty_str() { static const Str s; return s; }
+
+    sharedPtr<Str> handle; //空字符串时为空指针
+    bool leaked; //已经交出过可写的引用
+};
+
+const CowStr::size_type CowStr::npos;
+
+// 缓冲区相同时不需要比较内容
+inline bool operator==(const CowStr& a, const CowStr& b) { return a.str().data() == b.str().data() || a.str() == b.str(); }
+inline bool operator!=(const CowStr& a, const CowStr& b) { return !(a == b); }
+inline bool operator<(const CowStr& a, const CowStr& b) { return a.compare(b) < 0; }
+
+inline ostream& operator<<(ostream& os, const CowStr& s)
+{
+    return os << s.str();
+}
+
+namespace std
+{
+    template<>
+    struct hash<CowStr>
+    {
+        size_t operator()(const CowStr& s) const { return s.hash(); }
+    };
+}
+
+// sharedPtr::make_unique通过clone拷贝被共享的对象，Str没有clone成员函数，在这里特化
+template<>
+Str* clone(const Str* pt)
+{
+    return new Str(*pt);
+}
+
+
+CowStr& CowStr::operator=(const CowStr& s)
+{
+    if (&s != this)
+    {
+        handle = s.share();
+        leaked = false;
+    }
+
+    return *this;
+}
+
+
+CowStr& CowStr::operator=(CowStr&& s) noexcept
+{
+    if (&s != this)
+    {
+        handle = std::move(s.handle);
+        leaked = s.leaked;
+        s.leaked = false;
+    }
+
+    return *this;
+}
+
+
+// s可能就是本对象，先拷贝一份再追加
+CowStr& CowStr::operator+=(const CowStr& s)
+{
+    if (&s == this)
+    {
+        sharedPtr<Str> keep(handle);
+        unshare().append(*keep.get());
+    }
+    else
+        unshare().append(s.str());
+
+    return *this;
+}
+
+
+// 共享的缓冲区不能原地清空，直接放弃引用
+// 独占时原地清空并保留容量，之前交出的char&仍然指向这个缓冲区，所以leaked保持不变，之后的拷贝仍然深拷贝
+void CowStr::clear()
+{
+    if (shared())
+    {
+        handle.reset();
+        leaked = false;
+    }
+    else if (handle)
+        handle.get()->clear();
+}
+
+
+sharedPtr<Str> CowStr::share() const
+{
+    if (leaked)
+        return make_sharedPtr<Str>(*handle.get());
+
+    return handle;
+}
+
+
+Str& CowStr::unshare()
+{
+    if (!handle)
+        handle = make_sharedPtr<Str>();
+    else
+        handle.make_unique(); //只有计数大于1时才会clone
+
+    return *handle.get();
+}
+
+
+
+/* 公有成员函数的实现 */
+
+
+Str::ref Str::at(size_type n)
+{
+    if(n >= size())
+        throw "illegal position";
+
+    return data()[n];
+}
+
+
+Str& Str::operator=(const Str& s)
+{
+    if (&s != this)
+        assign(s.data(), s.size());
+
+    return *this;
+}
+
+
+Str& Str::operator=(Str&& s) noexcept
+{
+    if (&s != this)
+    {
+        release();
+        steal(s);
+    }
+
+    return *this;
+}
+
+
+void Str::reserve(size_type n)
+{
+    if (n <= capacity())
+        return;
+
+    size_type len = size();
+    char* p = allocate(n);
+    memcpy(p, data(), len + 1);
+    release();
+
+    heap.ptr = p;
+    heap.size = len;
+    small[SMALL_CAP + 1] = char(HEAP_FLAG);
+}
+
+
+void Str::push_back(const char c)
+{
+    size_type len = size();
+    if (len == capacity())
+        reserve(DoubleGrowth::next(capacity(), len + 1, 1));
+
+    data()[len] = c;
+    set_size(len + 1);
+}
+
+
+Str& Str::assign(const char* cp, size_type n)
+{
+    if (n <= capacity()) //容量足够时直接复用已有的内存
+    {
+        memmove(data(), cp, n);
+        set_size(n);
+    }
+    else
+    {
+        Str temp(cp, cp + n);
+        swap(temp);
+    }
+
+    return *this;
+}
+
+
+Str& Str::append(const char* cp, size_type n)
+{
+    size_type len = size();
+    if (n > capacity() - len)
+    {
+        // cp可能指向本对象的内容，所以先把两段都拷贝到新的内存中，再释放旧内存
+        Str temp;
+        temp.reserve(DoubleGrowth::next(capacity(), len + n, 1));
+        memcpy(temp.data(), data(), len);
+        memcpy(temp.data() + len, cp, n);
+        temp.set_size(len + n);
+        swap(temp);
+        return *this;
+    }
+
+    memmove(data() + len, cp, n);
+    set_size(len + n);
+    return *this;
+}
+
+
+void Str::swap(Str& s) noexcept
+{
+    // Str是可平凡重定位的，直接交换两个对象的字节即可
+    char temp[sizeof(Str)];
+    memcpy(temp, static_cast<void*>(this), sizeof(Str));
+    memcpy(static_cast<void*>(this), static_cast<void*>(&s), sizeof(Str));
+    memcpy(static_cast<void*>(&s), temp, sizeof(Str));
+}
+
+
+bool Str::operator==(const Str& s) const
+{
+    if (&s == this)
+        return true;
+
+    return size() == s.size() && bytes_equal(data(), s.data(), size());
+}
+
+
+// 先比较公共前缀，前缀相同时较短的字符串更小
+int Str::compare(const Str& s) const
+{
+    size_type n = min(size(), s.size());
+    int r = bytes_compare(data(), s.data(), n);
+    if (r != 0)
+        return r;
+
+    return size() < s.size() ? -1 : (size() > s.size() ? 1 : 0);
+}
+
+
+Str::size_type Str::find(char c, size_type pos) const
+{
+    if (pos >= size())
+        return npos;
+
+    size_type k = bytes_find_char(data() + pos, size() - pos, c);
+    return k == npos ? npos : pos + k;
+}
+
+
+Str::size_type Str::find(const char* cp, size_type pos, size_type n) const
+{
+    if (pos > size())
+        return npos;
+
+    size_type k = bytes_find(data() + pos, size() - pos, cp, n);
+    return k == npos ? npos : pos + k;
+}
+
+
+// 与标准库一致，查找起始位置不超过pos的最后一次出现
+Str::size_type Str::rfind(char c, size_type pos) const
+{
+    if (empty())
+        return npos;
+
+    return bytes_rfind_char(data(), min(pos, size() - 1) + 1, c);
+}
+
+
+Str::size_type Str::rfind(const char* cp, size_type pos, size_type n) const
+{
+    if (n > size())
+        return npos;
+
+    size_type last = min(pos, size() - n); //匹配的起始位置不超过last
+    return bytes_rfind(data(), last + n, cp, n);
+}
+
+
+/* 私有成员函数的实现 */
+
+// 构造一个长度为n的字符串，内容未初始化，只保证末尾的'\0'
+void Str::init(size_type n)
+{
+    if (n <= SMALL_CAP)
+    {
+        small[SMALL_CAP + 1] = char(n);
+        small[n] = '\0';
+    }
+    else
+    {
+        heap.ptr = allocate(n);
+        heap.size = n;
+        heap.ptr[n] = '\0';
+        small[SMALL_CAP + 1] = char(HEAP_FLAG);
+    }
+}
+
+
+void Str::set_size(size_type n)
+{
+    if (is_small())
+        small[SMALL_CAP + 1] = char(n);
+    else
+        heap.size = n;
+
+    data()[n] = '\0';
+}
+
+
+// 调用前本对象不持有堆内存，之后s变为空的短字符串
+void Str::steal(Str& s)
+{
+    memcpy(static_cast<void*>(this), static_cast<void*>(&s), sizeof(Str));
+    s.init(0);
+}
+
+
+void Str::release()
+{
+    if (!is_small())
+        deallocate(heap.ptr);
+
+    init(0);
+}
+
+
+// 容量存放在字符之前，+1是为了末尾的'\0'
+char* Str::allocate(size_type cap)
+{
+    size_type* block = static_cast<size_type*>(::operator new(sizeof(size_type) + cap + 1));
+    *block = cap;
+    return reinterpret_cast<char*>(block + 1);
+}
+
+
+
+/* 测试代码 */
+
+#if defined(DEBUG) && !defined(NO_MAIN)
+
+#include <sstream>
+
+// 每次underflow只提供chunk个字符，用来测试单词跨越缓冲区的情况；chunk为0时没有缓冲区，只能逐字符读取
+class ChunkBuf : public streambuf
+{
+public:
+    ChunkBuf(const char* text, size_t chunk): p(text), last(text + strlen(text)), n(chunk) {}
+
+protected:
+    int underflow()
+    {
+        if (p == last)
+            return traits_type::eof();
+        if (n != 0)
+        {
+            size_t len = min(n, size_t(last - p));
+            char* b = const_cast<char*>(p);
+            setg(b, b, b + len);
+            p += len;
+        }
+        return traits_type::to_int_type(n != 0 ? *gptr() : *p);
+    }
+
+    int uflow()
+    {
+        if (n != 0)
+            return streambuf::uflow();
+        return p == last ? traits_type::eof() : traits_type::to_int_type(*p++);
+    }
+
+private:
+    const char* p;
+    const char* last;
+    size_t n;
+};
+
+
+int main(int argc, char* argv[])
+{
+	{
+        Str str1(5, 'c');
+        Str str2 = "abcdefg";
+        Str str3(str2.begin(), str2.end());
+        assert(str1.size() == 5);
+        assert(str3.size() == 7);
+        assert(strcmp(str2.c_str(), "abcdefg") == 0);
+        str1.clear();
+        assert(str1.empty());
+        str1.push_back('d');
+        char dest[100] = {}; //copy_to不写入结尾的'\0'
+        str2.copy_to(dest);
+        assert(strcmp(dest, "abcdefg") == 0);
+        str3[0] = 'h';
+        assert(strcmp(str3.c_str(), "hbcdefg") == 0);
+        str2 += "123";
+        assert(strcmp(str2.c_str(), "abcdefg123") == 0);
+        assert(str2 == str2);
+        cout << str2;
+        assert(str1 == str1);
+
+        Str str4 = "short key"; //不超过22个字符，存放在对象内部
+        assert(str4.capacity() == 22 && (const char*)str4 >= (const char*)&str4 && (const char*)str4 < (const char*)(&str4 + 1));
+        const char* p = str4.c_str();
+        assert(p == str4.c_str() && p[str4.size()] == '\0'); //c_str不再重新分配内存
+        Str str5(30, 'x');
+        assert(str5.size() == 30 && str5.capacity() == 30 && str5.c_str()[30] == '\0');
+        str5 += str5; //追加自身并触发扩容
+        assert(str5.size() == 60 && str5[59] == 'x' && strlen(str5.c_str()) == 60);
+        Str str6(std::move(str5));
+        assert(str5.empty() && str6.size() == 60);
+        str5 = str4;
+        assert(str5 == str4 && str5.capacity() == 22);
+        str4 = std::move(str6);
+        assert(str4.size() == 60 && str6.empty());
+        str6 = str4; //短字符串容量不足时切换到堆上
+        assert(str6 == str4 && str6.capacity() >= 60);
+        str6 = "abc"; //容量足够，复用已有的堆内存
+        assert(str6.size() == 3 && str6.capacity() >= 60 && strcmp(str6, "abc") == 0);
+        for (int i = 0; i < 20; ++i)
+            str6.push_back('0' + i % 10);
+        assert(str6.size() == 23 && str6[22] == '9');
+        Str str7 = Str("0123456789") + Str("0123456789") + Str("012"); //23个字符，正好超过内嵌容量
+        assert(str7.size() == 23 && str7.capacity() > 22 && str7.c_str()[23] == '\0');
+        Str str8 = str4 + " " + 'x' + "" + str5 + '!'; //一次分配
+        assert(str8.size() == 60 + 1 + 1 + 9 + 1 && str8[60] == ' ' && str8[61] == 'x' && str8[71] == '!');
+        str8 = str8 + str8; //表达式引用了自身
+        assert(str8.size() == 144 && str8[143] == '!' && str8[72] == 'x');
+        str5 += "-" + str5 + '-';
+        assert(str5 == Str("short key-short key-"));
+        Str str9 = Str("a") + Str("b");
+        assert(str9 == Str("ab"));
+
+        StrBuilder sb(64);
+        sb << "[" << 42 << "] " << str9 << ' ' << -9223372036854775807LL - 1 << " " << 18446744073709551615ULL;
+        assert(strcmp(sb.c_str(), "[42] ab -9223372036854775808 18446744073709551615") == 0);
+        sb.clear();
+        sb.append("x = ").append(0).append(str9 + "!");
+        assert(sb.str() == Str("x = 0ab!") && sb.capacity() >= 64);
+        Str str10 = sb.release();
+        assert(str10 == Str("x = 0ab!") && sb.size() == 0);
+        StrView csv("id,name,age");
+        sb << csv.substr(3, 4) << '=';
+        sb.append(csv.substr(0, 2)).append(StrView("; ")) << StrView(str9);
+        assert(sb.str() == Str("name=id; ab"));
+        sb.clear();
+
+        str7.swap(str1);
+        assert(str1.size() == 23 && str7 == Str("d"));
+
+        Str str11 = Str("the quick brown fox jumps over the lazy dog, the end");
+        assert(str11.find('q') == 4 && str11.find('t', 1) == 31 && str11.find('#') == Str::npos);
+        assert(str11.rfind('t') == 45 && str11.rfind('t', 44) == 31 && str11.rfind('t', 0) == 0);
+        assert(str11.find("the") == 0 && str11.find("the", 1) == 31 && str11.find(Str("lazy dog")) == 35);
+        assert(str11.rfind("the") == 45 && str11.rfind("the", 44) == 31 && str11.rfind("cat") == Str::npos);
+        assert(str11.find("") == 0 && str11.rfind("") == str11.size() && str11.find("end", 60) == Str::npos);
+        assert(Str().find('a') == Str::npos && Str().rfind('a') == Str::npos && Str().rfind("a") == Str::npos);
+        assert(Str("abc") < Str("abd") && Str("abc") < Str("abcd") && Str("b") > Str("abcd"));
+        assert(Str("abc").compare(Str("abc")) == 0 && Str("abc") <= Str("abc") && Str("abc") != Str("ab"));
+        assert(Str("\xF0") > Str("a")); //按无符号字节比较
+        assert(Str("key").hash() == Str("key").hash() && Str("key").hash() != Str("kez").hash());
+        assert(std::hash<Str>()(str11) == str11.hash());
+
+        StrView view1 = str11; //视图直接指向str11的字符
+        assert(view1.data() == str11.data() && view1 == str11 && str11 == view1);
+        StrView view2 = str11.substr(4, 5);
+        assert(view2 == "quick" && view2.data() == str11.data() + 4);
+        Str str12(view2); //显式拷贝出一个独立的Str
+        assert(str12 == Str("quick") && str12.data() != view2.data());
+        str12 += StrView(" fox ");
+        str12.append(str11.substr(40));
+        assert(str12 == Str("quick fox dog, the end"));
+        Str str13 = view2 + "-" + str11.substr(10, 5); //视图也可以参与连接表达式
+        assert(str13 == Str("quick-brown"));
+        // 连接表达式可以直接参与比较，也可以直接取c_str()，和operator+返回Str时的写法一样
+        Str quick("quick"), brown("brown");
+        assert((quick + "-" + brown) == str13 && str13 == (quick + "-" + brown) && (quick + "-" + brown) == "quick-brown");
+        assert((quick + brown) != (brown + quick) && (brown + quick) < (quick + brown) && view2 + "" == view2);
+        assert((quick + 'x') > quick && (quick + "") >= quick && "quick" <= (quick + 'x'));
+        assert(strcmp((quick + "-" + brown).c_str(), "quick-brown") == 0 && (quick + brown).str().size() == 10);
+        size_t fields = 0;
+        for (StrView field : StrView(str11).split(' '))
+            fields += field.empty() ? 0 : 1;
+        assert(fields == 11);
+
+        const char* text = "  alpha\tbeta_is_a_longer_word\n\n gamma \r\n";
+        const char* words[] = { "alpha", "beta_is_a_longer_word", "gamma" };
+        for (size_t chunk = 0; chunk < 8; ++chunk)
+        {
+            ChunkBuf buf(text, chunk);
+            istream is(&buf);
+            Str word;
+            for (int i = 0; i < 3; ++i)
+            {
+                assert(is >> word);
+                assert(word == Str(words[i]));
+            }
+            assert(!(is >> word) && is.eof() && word.empty());
+        }
+        for (size_t chunk = 0; chunk < 8; ++chunk)
+        {
+            ChunkBuf buf("first line\n\nthird, a bit longer\nlast", chunk);
+            istream is(&buf);
+            Str line;
+            assert(getline(is, line) && line == Str("first line"));
+            assert(getline(is, line) && line.empty());
+            assert(getline(is, line) && line == Str("third, a bit longer"));
+            assert(getline(is, line) && line == Str("last") && is.eof());
+            assert(!getline(is, line));
+        }
+        istringstream iss("key value\nnext");
+        Str key, rest;
+        iss >> key;
+        getline(iss, rest); //>>把单词后面的空白留在流中
+        assert(key == Str("key") && rest == Str(" value"));
+        getline(iss, rest, 'z');
+        assert(rest == Str("next") && iss.eof());
+
+        Vec<Str> v1;
+        for (int i = 0; i < 10; ++i)
+            v1.push_back(i % 2 ? Str(5, 'a') : Str(40, 'b'));
+        v1.erase(v1.begin());
+        assert(v1.size() == 9 && v1[0] == Str(5, 'a') && v1[7] == Str(40, 'b'));
+	}
+
+    {
+        // 拷贝只共享缓冲区，修改时才分离
+        Str big(1000, 'x');
+        CowStr c1(big);
+        CowStr c2 = c1;
+        CowStr c3;
+        c3 = c2;
+        assert(c1.shared() && c2.shared() && c1.str().data() == c2.str().data() && c3.str().data() == c1.str().data());
+        const CowStr& r2 = c2;
+        assert(r2[0] == 'x' && r2.size() == 1000 && c2.shared()); //通过const引用读取不分离
+        c2 += "tail";
+        assert(c2.size() == 1004 && c1.size() == 1000 && c2.str().data() != c1.str().data() && !c2.shared() && c1.shared());
+        c3.push_back('y');
+        assert(!c1.shared() && c3.size() == 1001 && c1 == CowStr(big));
+        c3 += c3;
+        const CowStr& r3 = c3;
+        assert(c3.size() == 2002 && r3[1000] == 'y' && r3[2001] == 'y');
+
+        // 交出可写引用后不再共享，否则通过引用的写入会影响副本
+        CowStr c4("hello");
+        char& h = c4[0];
+        CowStr c5 = c4;
+        h = 'j';
+        assert(c4 == CowStr("jello") && c5 == CowStr("hello") && !c4.shared());
+        c5 = c4; //赋值时同样深拷贝
+        assert(c5.str().data() != c4.str().data());
+        c4.clear(); //原地清空后h仍然指向c4的缓冲区
+        c4 += "abc";
+        CowStr c6(c4);
+        h = 'X';
+        assert(c6 == CowStr("abc") && c4 == CowStr("Xbc") && c6.str().data() != c4.str().data());
+
+        CowStr e1, e2(e1);
+        assert(e1.empty() && e2 == e1 && e1.c_str()[0] == '\0' && !e1.shared());
+        e2 += 'a';
+        assert(e1.empty() && e2 == CowStr("a"));
+
+        CowStr m1("moved"), m2(std::move(m1));
+        assert(m1.empty() && m2 == CowStr("moved"));
+        CowStr s1 = m2;
+        s1.clear(); //共享时只放弃引用
+        assert(s1.empty() && m2 == CowStr("moved") && !m2.shared());
+        m2.swap(s1);
+        assert(m2.empty() && s1.find('v') == 2 && StrView(s1) == "moved");
+        assert(std::hash<CowStr>()(s1) == Str("moved").hash() && CowStr("a") < CowStr("b") && CowStr("a") != CowStr("b"));
+    }
+
+	_CrtDumpMemoryLeaks();
+	//由于该检测手法实在main函数推出前检测，而此时各个类实例还没出作用域
+	//所以一直会存在内存泄漏，解决方法就是多加一层括号
+}
+
+#endif // DEBUG
+
+
+/* 性能测试代码 */
+
+#if defined(BENCHMARK) && !defined(NO_MAIN)
+
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <fstream>
+#include <new>
+
+static size_t alloc_count = 0;
+
+void* operator new(size_t n)
+{
+    ++alloc_count;
+    if (void* p = malloc(n))
+        return p;
+    throw bad_alloc();
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+
+// 改动之前的布局：Vec<char>存放字符，c_str()时再拷贝一份带'\0'的数据到另一块堆内存
+class VecStr
+{
+public:
+    VecStr(): pt(nullptr) {}
+    VecStr(const char* cp): pt(nullptr) { string.insert(string.end(), cp, cp + strlen(cp)); }
+    VecStr(const VecStr& s): string(s.string), pt(nullptr) {}
+    ~VecStr() { delete[] pt; }
+
+    size_t size() const { return string.size(); }
+    bool operator==(const VecStr& s) const { return string.size() == s.string.size() && equal(string.begin(), string.end(), s.string.begin()); }
+    const char* c_str()
+    {
+        delete[] pt;
+        pt = new char[string.size() + 1];
+        copy(string.begin(), string.end(), pt);
+        pt[string.size()] = '\0';
+        return pt;
+    }
+
+private:
+    Vec<char> string;
+    char* pt;
+};
+
+
+// 典型的短键负载：构造一批8~20个字符的键，拷贝进容器，逐个比较并取c_str()
+template<typename S>
+void bench_short_keys(const char* name, size_t n)
+{
+    Vec<Str> keys;
+    for (size_t i = 0; i < n; ++i)
+    {
+        Str key = "user:";
+        for (size_t k = i; ; k /= 10)
+        {
+            key.push_back(char('0' + k % 10));
+            if (k < 10)
+                break;
+        }
+        keys.push_back(key);
+    }
+
+    alloc_count = 0;
+    auto start = chrono::steady_clock::now();
+    size_t hits = 0, total = 0;
+    {
+        Vec<S> table;
+        for (size_t i = 0; i < n; ++i)
+            table.push_back(S(keys[i].c_str()));
+        for (size_t i = 0; i < n; ++i)
+        {
+            S probe(keys[n - 1 - i].c_str());
+            hits += probe == table[i];
+            total += strlen(table[i].c_str());
+        }
+    }
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    cout << name << ": sizeof " << sizeof(S) << ", " << alloc_count << " allocations, " << ms << " ms (" << hits + total << ")" << endl;
+}
+
+
+// 改动之前operator+的做法：每个加号都拷贝一次左边并生成一个临时Str
+Str eager_concat(const Str& left, const Str& right)
+{
+    Str result = left;
+    result += right;
+    return result;
+}
+
+
+// 拼接一行日志：时间戳 [级别] 模块: 消息
+void bench_log_lines(size_t n)
+{
+    Str ts = "2024-05-01T12:00:00.000Z", level = "INFO", module = "request-handler";
+    Str msg = "finished processing request with status ok";
+    size_t total = 0;
+
+    alloc_count = 0;
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < n; ++i)
+    {
+        Str line = eager_concat(eager_concat(eager_concat(eager_concat(eager_concat(eager_concat(ts, " ["), level), "] "), module), ": "), msg);
+        total += line.size();
+    }
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    cout << "log line, temporary per +: " << alloc_count << " allocations, " << ms << " ms" << endl;
+
+    alloc_count = 0;
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < n; ++i)
+    {
+        Str line = ts + " [" + level + "] " + module + ": " + msg;
+        total += line.size();
+    }
+    ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    cout << "log line, concat expression: " << alloc_count << " allocations, " << ms << " ms" << endl;
+
+    alloc_count = 0;
+    start = chrono::steady_clock::now();
+    StrBuilder sb(256);
+    for (size_t i = 0; i < n; ++i)
+    {
+        sb.clear();
+        sb << ts << " [" << level << "] " << module << ": " << msg << " #" << i;
+        total += sb.size();
+    }
+    ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    cout << "log line, reused StrBuilder: " << alloc_count << " allocations, " << ms << " ms (" << total << ")" << endl;
+}
+
+
+// 把CSV格式的行切分成字段：之前每个字段都要用Str(begin, end)拷贝一份，现在只需要视图
+void bench_tokenize(size_t n)
+{
+    Str line = "1718000000,GET,/api/v1/users/12345/profile,200,0.0132,Mozilla/5.0 (X11; Linux x86_64)";
+    size_t total = 0;
+
+    alloc_count = 0;
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < n; ++i)
+    {
+        const char* b = line.begin();
+        for (const char* p = b; ; ++p)
+        {
+            if (p == line.end() || *p == ',')
+            {
+                Str field(b, p);
+                total += field.size();
+                if (p == line.end())
+                    break;
+                b = p + 1;
+            }
+        }
+    }
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    cout << "tokenize, Str per field: " << alloc_count << " allocations, " << ms << " ms" << endl;
+
+    alloc_count = 0;
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < n; ++i)
+    {
+        for (StrView field : StrView(line).split(','))
+            total += field.size();
+    }
+    ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    cout << "tokenize, StrView split: " << alloc_count << " allocations, " << ms << " ms (" << total << ")" << endl;
+}
+
+
+// 改动之前的operator>>：用is.get()逐个字符读取并push_back
+istream& read_word_by_char(istream& is, Str& s)
+{
+    s.clear();
+
+    char c;
+    while(is.get(c) && isspace(c))
+        ;
+
+    if(is)
+    {
+        do
+        {
+            s.push_back(c);
+        } while (is.get(c) && !isspace(c));
+    }
+
+    return is;
+}
+
+
+// 生成mb兆字节的文本，单词长度1~15个字符，以空格分隔，平均每行约80个字符
+void write_words_file(const char* path, size_t mb)
+{
+    ofstream out(path, ios::binary);
+    Str line;
+    srand(1);
+    for (size_t written = 0; written < (mb << 20); written += line.size())
+    {
+        line.clear();
+        while (line.size() < 80)
+        {
+            size_t len = 1 + rand() % 15;
+            for (size_t i = 0; i < len; ++i)
+                line.push_back(char('a' + rand() % 26));
+            line.push_back(' ');
+        }
+        line.push_back('\n');
+        out.write(line.data(), line.size());
+    }
+}
+
+
+template<typename Read>
+void time_read(const char* name, const char* path, Read read)
+{
+    ifstream in(path, ios::binary);
+    size_t count = 0, bytes = 0;
+    auto start = chrono::steady_clock::now();
+    read(in, count, bytes);
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    cout << name << ": " << count << " items, " << bytes << " bytes, " << ms << " ms" << endl;
+}
+
+
+void bench_stream_input(size_t mb)
+{
+    const char* path = "str_bench_words.txt";
+    write_words_file(path, mb);
+
+    time_read("words, is.get() per char", path, [](istream& in, size_t& count, size_t& bytes) {
+        Str w;
+        while (read_word_by_char(in, w)) { ++count; bytes += w.size(); }
+    });
+    time_read("words, buffered operator>>", path, [](istream& in, size_t& count, size_t& bytes) {
+        Str w;
+        while (in >> w) { ++count; bytes += w.size(); }
+    });
+    time_read("words, std::string", path, [](istream& in, size_t& count, size_t& bytes) {
+        string w;
+        while (in >> w) { ++count; bytes += w.size(); }
+    });
+    time_read("lines, buffered getline", path, [](istream& in, size_t& count, size_t& bytes) {
+        Str line;
+        while (getline(in, line)) { ++count; bytes += line.size(); }
+    });
+    time_read("lines, std::getline", path, [](istream& in, size_t& count, size_t& bytes) {
+        string line;
+        while (std::getline(in, line)) { ++count; bytes += line.size(); }
+    });
+
+    remove(path);
+}
+
+
+// 流水线的每一级按值接收消息，只读取内容（计算哈希），再交给下一级；每条消息还会被保存一份用于重试
+// 最后一级在末尾追加校验信息，这是唯一的修改
+template<typename S>
+S pipeline_stage(S msg, size_t& acc)
+{
+    const S& view = msg;
+    acc += view.hash();
+    return msg;
+}
+
+template<typename S>
+void bench_pipeline(const char* name, size_t messages, size_t bytes)
+{
+    Vec<S> inbox;
+    for (size_t i = 0; i < messages; ++i)
+        inbox.push_back(S(Str(bytes, char('a' + i % 26))));
+
+    size_t before = alloc_count, acc = 0;
+    auto start = chrono::steady_clock::now();
+    Vec<S> retry;
+    for (size_t i = 0; i < messages; ++i)
+    {
+        retry.push_back(inbox[i]);
+        S msg = inbox[i];
+        for (int stage = 0; stage < 5; ++stage)
+            msg = pipeline_stage(msg, acc);
+        msg += "|checksum";
+        acc += msg.size();
+    }
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    cout << name << ": " << messages << " messages of " << bytes << " bytes through 5 stages " << ms << " ms, "
+         << alloc_count - before << " allocations (" << acc % 10 << ")" << endl;
+}
+
+
+int main(int argc, char* argv[])
+{
+    size_t n = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000000;
+    size_t mb = argc > 2 ? strtoul(argv[2], nullptr, 10) : 256; //读取测试的文件大小
+
+    bench_short_keys<VecStr>("Vec<char> + c_str copy", n);
+    bench_short_keys<Str>("SSO Str", n);
+    bench_log_lines(n);
+    bench_tokenize(n);
+    bench_stream_input(mb);
+    bench_pipeline<Str>("Str", 64, 1 << 20);
+    bench_pipeline<CowStr>("CowStr", 64, 1 << 20);
+}
+
+#endif // BENCHMARK
+
+#endif // STR_CPP
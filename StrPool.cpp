@@ -0,0 +1,450 @@
+// 字符串驻留池：相同内容的字符串在池中只保存一份，intern返回指向这一份的句柄InternedStr
+// 同一个池返回的句柄内容相同当且仅当指针相同，比较和哈希都是O(1)，适合符号表、关键字、字段名这类反复比较的少量字符串
+// 字符存放在Arena中，池存在期间不会移动也不会释放，句柄和由它得到的StrView在池析构前一直有效
+// 池按哈希值分成若干分片，每个分片有自己的锁、哈希表和Arena，多个线程可以同时intern
+
+#ifndef STRPOOL_CPP
+#define STRPOOL_CPP
+
+#pragma push_macro("NO_MAIN") //只引入实现，不引入它们的测试代码
+#define NO_MAIN
+#include "Str.cpp"
+#pragma pop_macro("NO_MAIN")
+#include <mutex>
+#include <cstring>
+#include <functional>
+#include <crtdbg.h>
+#include <assert.h>
+
+using namespace std;
+
+#ifndef BENCHMARK
+#define DEBUG
+#endif
+
+
+// 池中的一个字符串：头部之后紧跟len个字符和'\0'，整体一次从Arena中分配
+struct InternEntry
+{
+    size_t hash;
+    size_t len;
+
+    const char* chars() const { return reinterpret_cast<const char*>(this + 1); }
+};
+
+
+// 只有一个指针大小，可以按值传递；默认构造的句柄表示空串，与任何池中intern("")的结果相等
+class InternedStr
+{
+    friend class StrPool;
+public:
+    InternedStr(): entry(&empty_entry().head) {}
+
+    size_t size() const { return entry->len; }
+    bool empty() const { return entry->len == 0; }
+    const char* data() const { return entry->chars(); }
+    const char* c_str() const { return entry->chars(); } //以'\0'结尾
+    StrView view() const { return StrView(entry->chars(), entry->len); }
+    operator StrView() const { return view(); }
+    Str str() const { return Str(view()); }
+    size_t hash() const { return entry->hash; } //intern时已经算好
+    const void* id() const { return entry; } //同一个池中，内容相同的字符串id相同
+
+    bool operator==(InternedStr s) const { return entry == s.entry; }
+    bool operator!=(InternedStr s) const { return entry != s.entry; }
+    bool operator<(InternedStr s) const { return entry < s.entry; } //按地址排序，只用于有序容器，不是字典序
+
+private:
+    explicit InternedStr(const InternEntry* e): entry(e) {}
+
+    struct EmptyEntry
+    {
+        InternEntry head;
+        char nul;
+    };
+    static const EmptyEntry& empty_entry() { static const EmptyEntry e = { { size_t(bytes_hash("", 0)), 0 }, '\0' }; return e; }
+
+    const InternEntry* entry;
+};
+
+
+inline ostream& operator<<(ostream& os, InternedStr s)
+{
+    return os << s.view();
+}
+
+namespace std
+{
+    template<>
+    struct hash<InternedStr>
+    {
+        size_t operator()(InternedStr s) const { return s.hash(); }
+    };
+}
+
+
+class StrPool
+{
+public:
+    enum { SHARD_BITS = 4, SHARDS = 1 << SHARD_BITS }; //分片数是2的幂，由哈希值的最高SHARD_BITS位选择
+
+    StrPool() {}
+    StrPool(const StrPool&) = delete;
+    StrPool& operator=(const StrPool&) = delete;
+
+    InternedStr intern(StrView s); //不存在时加入池中
+    InternedStr lookup(StrView s) const; //只查找，不存在时返回空串的句柄，found为false
+    InternedStr lookup(StrView s, bool& found) const;
+    size_t size() const; //不同字符串的个数，不含空串
+
+private:
+    // 开放定址、线性探测的哈希表，保存指向Arena中条目的指针；装载因子超过1/2时容量翻倍
+    struct Shard
+    {
+        mutable mutex lock;
+        Vec<const InternEntry*> slots; //容量为2的幂，空位为nullptr
+        size_t count;
+        Arena arena;
+
+        Shard(): count(0), arena(16384) {}
+        const InternEntry* find(StrView s, size_t h) const;
+        const InternEntry* insert(StrView s, size_t h);
+        void rehash();
+    };
+
+    // 低位用来选择表中的位置，高位用来选择分片，两者互不相关
+    static size_t shard_of(size_t h) { return h >> (sizeof(size_t) * 8 - SHARD_BITS); }
+
+    Shard shards[SHARDS];
+};
+
+
+
+/* 公有成员函数的实现 */
+
+InternedStr StrPool::intern(StrView s)
+{
+    if (s.empty())
+        return InternedStr();
+
+    size_t h = s.hash();
+    Shard& shard = shards[shard_of(h)];
+    lock_guard<mutex> guard(shard.lock);
+    const InternEntry* e = shard.find(s, h);
+    return InternedStr(e ? e : shard.insert(s, h));
+}
+
+
+InternedStr StrPool::lookup(StrView s, bool& found) const
+{
+    found = true;
+    if (s.empty())
+        return InternedStr();
+
+    size_t h = s.hash();
+    const Shard& shard = shards[shard_of(h)];
+    lock_guard<mutex> guard(shard.lock);
+    const InternEntry* e = shard.find(s, h);
+    found = e != nullptr;
+    return e ? InternedStr(e) : InternedStr();
+}
+
+
+InternedStr StrPool::lookup(StrView s) const
+{
+    bool found;
+    return lookup(s, found);
+}
+
+
+size_t StrPool::size() const
+{
+    size_t n = 0;
+    for (int i = 0; i < SHARDS; ++i)
+    {
+        lock_guard<mutex> guard(shards[i].lock);
+        n += shards[i].count;
+    }
+    return n;
+}
+
+
+
+/* 私有成员函数的实现 */
+
+// 先比较哈希值，只有哈希值相同时才比较内容
+const InternEntry* StrPool::Shard::find(StrView s, size_t h) const
+{
+    if (slots.empty())
+        return nullptr;
+
+    size_t mask = slots.size() - 1;
+    for (size_t i = h & mask; slots[i] != nullptr; i = (i + 1) & mask)
+    {
+        const InternEntry* e = slots[i];
+        if (e->hash == h && e->len == s.size() && bytes_equal(e->chars(), s.data(), s.size()))
+            return e;
+    }
+    return nullptr;
+}
+
+
+const InternEntry* StrPool::Shard::insert(StrView s, size_t h)
+{
+    if (2 * (count + 1) > slots.size())
+        rehash();
+
+    InternEntry* e = static_cast<InternEntry*>(arena.allocate(sizeof(InternEntry) + s.size() + 1, alignof(InternEntry)));
+    e->hash = h;
+    e->len = s.size();
+    char* chars = reinterpret_cast<char*>(e + 1);
+    memcpy(chars, s.data(), s.size());
+    chars[s.size()] = '\0';
+
+    size_t mask = slots.size() - 1;
+    size_t i = h & mask;
+    while (slots[i] != nullptr)
+        i = (i + 1) & mask;
+    slots[i] = e;
+    ++count;
+    return e;
+}
+
+
+// 条目本身不动，只把指针重新放入更大的表
+void StrPool::Shard::rehash()
+{
+    Vec<const InternEntry*> old(std::move(slots));
+    Vec<const InternEntry*> bigger(old.empty() ? 64 : old.size() * 2, nullptr);
+    slots = std::move(bigger);
+
+    size_t mask = slots.size() - 1;
+    for (size_t j = 0; j < old.size(); ++j)
+    {
+        if (old[j] == nullptr)
+            continue;
+        size_t i = old[j]->hash & mask;
+        while (slots[i] != nullptr)
+            i = (i + 1) & mask;
+        slots[i] = old[j];
+    }
+}
+
+
+
+/* 测试代码 */
+
+// 被其他文件include时，定义NO_MAIN来跳过这里的测试代码和性能测试代码
+#if defined(DEBUG) && !defined(NO_MAIN)
+
+#include <thread>
+#include <unordered_map>
+
+int main(int argc, char* argv[])
+{
+    {
+        StrPool pool;
+        InternedStr a = pool.intern("alpha");
+        Str dynamic("al");
+        dynamic += "pha";
+        InternedStr b = pool.intern(dynamic);
+        InternedStr c = pool.intern(StrView("alphabet").substr(0, 5));
+        assert(a == b && b == c && a.id() == c.id() && a.data() == b.data()); //只保存一份
+        assert(a.view() == "alpha" && strcmp(a.c_str(), "alpha") == 0 && a.size() == 5 && a.str() == Str("alpha"));
+        assert(a.hash() == StrView("alpha").hash() && std::hash<InternedStr>()(a) == a.hash());
+
+        InternedStr d = pool.intern("beta");
+        assert(d != a && pool.size() == 2);
+        bool found = true;
+        assert(pool.lookup("gamma", found).empty() && !found && pool.size() == 2);
+        assert(pool.lookup("beta", found) == d && found);
+
+        InternedStr e, f = pool.intern("");
+        assert(e == f && e.empty() && e.c_str()[0] == '\0' && pool.size() == 2);
+
+        // 长字符串和大量字符串：触发多次rehash后句柄仍然有效
+        Str long_key(1000, 'k');
+        InternedStr g = pool.intern(long_key);
+        Vec<InternedStr> handles;
+        for (int i = 0; i < 5000; ++i)
+        {
+            StrBuilder sb;
+            sb << "sym" << i;
+            handles.push_back(pool.intern(sb.str()));
+        }
+        assert(pool.size() == 5003 && g.size() == 1000 && g == pool.intern(Str(1000, 'k')));
+        for (int i = 0; i < 5000; i += 97)
+        {
+            StrBuilder sb;
+            sb << "sym" << i;
+            assert(pool.lookup(sb.str()) == handles[i] && handles[i].view() == StrView(sb.str()));
+        }
+
+        unordered_map<InternedStr, int> counts;
+        counts[a] += 1;
+        counts[b] += 1;
+        counts[d] += 1;
+        assert(counts.size() == 2 && counts[c] == 2);
+
+        // 不同的池中，内容相同的字符串是不同的句柄
+        StrPool other;
+        assert(other.intern("alpha") != a && other.intern("alpha").view() == a.view());
+    }
+
+    {
+        // 多个线程同时intern相同的一批字符串，每个字符串在池中只有一份
+        StrPool pool;
+        const int threads = 4, keys = 2000;
+        Vec<InternedStr> results[threads];
+        Vec<thread> workers;
+        for (int t = 0; t < threads; ++t)
+            workers.push_back(thread([&pool, &results, t]() {
+                for (int i = 0; i < keys; ++i)
+                {
+                    int k = (i * 7 + t * 13) % keys; //各线程的顺序不同
+                    StrBuilder sb;
+                    sb << "key_" << k;
+                    results[t].push_back(pool.intern(sb.str()));
+                }
+            }));
+        for (int t = 0; t < threads; ++t)
+            workers[t].join();
+
+        assert(pool.size() == size_t(keys));
+        for (int t = 0; t < threads; ++t)
+            for (int i = 0; i < keys; ++i)
+            {
+                StrBuilder sb;
+                sb << "key_" << (i * 7 + t * 13) % keys;
+                assert(results[t][i] == pool.lookup(sb.str()) && results[t][i].view() == StrView(sb.str()));
+            }
+    }
+
+    _CrtDumpMemoryLeaks();
+}
+
+#endif // DEBUG
+
+
+/* 性能测试代码 */
+
+#if defined(BENCHMARK) && !defined(NO_MAIN)
+
+#include <thread>
+#include <chrono>
+#include <cstdlib>
+#include <unordered_map>
+
+double ms_since(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+
+// 符号表负载：源码中的标识符来自几千个不同的名字，每个出现很多次
+// 分别用Str和InternedStr：1）和一组关键字逐个比较；2）在哈希表中统计出现次数
+void bench_symbols(size_t symbols, size_t tokens)
+{
+    Vec<Str> names;
+    for (size_t i = 0; i < symbols; ++i)
+    {
+        StrBuilder sb;
+        sb << "identifier_" << (i * 2654435761u) % 1000003;
+        names.push_back(sb.str());
+    }
+    Vec<Str> text; //源码中的标识符，每个都是独立的Str对象
+    srand(1);
+    for (size_t i = 0; i < tokens; ++i)
+        text.push_back(names[size_t(rand()) % symbols]);
+
+    StrPool pool;
+    auto start = chrono::steady_clock::now();
+    Vec<InternedStr> interned;
+    interned.reserve(tokens);
+    for (size_t i = 0; i < tokens; ++i)
+        interned.push_back(pool.intern(text[i]));
+    double intern_ms = ms_since(start);
+
+    const int K = 8;
+    Str keywords[K];
+    InternedStr ikeywords[K];
+    for (int k = 0; k < K; ++k)
+    {
+        keywords[k] = names[k * 37 % symbols];
+        ikeywords[k] = pool.intern(keywords[k]);
+    }
+
+    size_t hits = 0;
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < tokens; ++i)
+        for (int k = 0; k < K; ++k)
+            hits += text[i] == keywords[k];
+    double str_cmp_ms = ms_since(start);
+
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < tokens; ++i)
+        for (int k = 0; k < K; ++k)
+            hits -= interned[i] == ikeywords[k];
+    double interned_cmp_ms = ms_since(start);
+
+    start = chrono::steady_clock::now();
+    unordered_map<Str, size_t> str_counts;
+    for (size_t i = 0; i < tokens; ++i)
+        ++str_counts[text[i]];
+    double str_map_ms = ms_since(start);
+
+    start = chrono::steady_clock::now();
+    unordered_map<InternedStr, size_t> interned_counts;
+    for (size_t i = 0; i < tokens; ++i)
+        ++interned_counts[interned[i]];
+    double interned_map_ms = ms_since(start);
+
+    cout << symbols << " symbols, " << tokens << " tokens: intern all " << intern_ms << " ms; keyword compare Str " << str_cmp_ms
+         << " ms, InternedStr " << interned_cmp_ms << " ms; count in hash map Str " << str_map_ms << " ms, InternedStr "
+         << interned_map_ms << " ms" << (hits == 0 && str_counts.size() == interned_counts.size() ? "" : " (mismatch)") << endl;
+}
+
+
+// 多个线程同时intern同一批名字，分片之间的锁互不影响
+void bench_concurrent_intern(size_t symbols, size_t per_thread)
+{
+    int cores = int(thread::hardware_concurrency());
+    if (cores < 1)
+        cores = 1;
+
+    Vec<Str> names;
+    for (size_t i = 0; i < symbols; ++i)
+    {
+        StrBuilder sb;
+        sb << "field_" << i;
+        names.push_back(sb.str());
+    }
+
+    for (int threads = 1; threads <= cores; threads = (threads * 2 > cores && threads < cores) ? cores : threads * 2) //1, 2, 4...，最后一行总是用全部核心
+    {
+        StrPool pool;
+        Vec<thread> workers;
+        auto start = chrono::steady_clock::now();
+        for (int t = 0; t < threads; ++t)
+            workers.push_back(thread([&pool, &names, symbols, per_thread, t]() {
+                for (size_t i = 0; i < per_thread; ++i)
+                    pool.intern(names[(i + t * 7919) % symbols]);
+            }));
+        for (int t = 0; t < threads; ++t)
+            workers[t].join();
+        double ms = ms_since(start);
+        cout << threads << " thread(s) x " << per_thread << " interns: " << ms << " ms, " << threads * per_thread / ms / 1000 << " M/s" << endl;
+    }
+}
+
+
+int main(int argc, char* argv[])
+{
+    size_t tokens = argc > 1 ? strtoul(argv[1], nullptr, 10) : 10000000;
+    bench_symbols(4096, tokens);
+    bench_concurrent_intern(4096, tokens);
+}
+
+#endif // BENCHMARK
+
+#endif // STRPOOL_CPP
@@ -0,0 +1,372 @@
+// 不拥有内存的字符串视图：只保存指针和长度，截取、查找、切分都只是在原来的字符上移动指针，不分配内存
+// Str可以隐式转换为StrView，视图的有效期不能超过它所引用的字符串，底层字符串修改后视图也会失效
+
+#ifndef STRVIEW_CPP
+#define STRVIEW_CPP
+
+#pragma push_macro("NO_MAIN") //只引入实现，不引入它们的测试代码
+#define NO_MAIN
+#include "Simd.cpp"
+#pragma pop_macro("NO_MAIN")
+#include <ctype.h>
+#include <cstring>
+#include <iostream>
+#include <functional>
+#include <crtdbg.h>
+#include <assert.h>
+
+using namespace std;
+
+#ifndef BENCHMARK
+#define DEBUG
+#endif
+
+class Str;
+class StrSplit;
+
+class StrView
+{
+public:
+    typedef size_t size_type;
+    typedef const char* const_iter;
+    static const size_type npos = BYTES_NPOS;
+
+    StrView(): ptr(""), len(0) {}
+    StrView(const char* cp): ptr(cp), len(strlen(cp)) {}
+    StrView(const char* cp, size_type n): ptr(cp), len(n) {}
+    StrView(const char* begin, const char* end): ptr(begin), len(end - begin) {}
+    StrView(const Str& s); //在Str.cpp中定义，这样Str不需要转换运算符，StrView(s)也不会与const char*的转换产生歧义
+
+    bool empty() const { return len == 0; }
+    size_type size() const { return len; }
+    const char* data() const { return ptr; } //不保证以'\0'结尾
+    const_iter begin() const { return ptr; }
+    const_iter end() const { return ptr + len; }
+    char front() const { return ptr[0]; }
+    char back() const { return ptr[len - 1]; }
+    char operator[](size_type n) const { return ptr[n]; }
+    char at(size_type n) const;
+
+    StrView substr(size_type pos, size_type n = npos) const;
+    void remove_prefix(size_type n) { ptr += n; len -= n; }
+    void remove_suffix(size_type n) { len -= n; }
+    StrView ltrim() const;
+    StrView rtrim() const;
+    StrView trim() const { return ltrim().rtrim(); }
+    bool starts_with(StrView s) const { return len >= s.len && bytes_equal(ptr, s.ptr, s.len); }
+    bool ends_with(StrView s) const { return len >= s.len && bytes_equal(ptr + len - s.len, s.ptr, s.len); }
+    StrSplit split(char delim) const;
+
+    int compare(StrView s) const;
+    size_type find(char c, size_type pos = 0) const;
+    size_type find(StrView s, size_type pos = 0) const;
+    size_type rfind(char c, size_type pos = npos) const;
+    size_type rfind(StrView s, size_type pos = npos) const;
+    size_t hash() const { return size_t(bytes_hash(ptr, len)); }
+
+private:
+    const char* ptr;
+    size_type len;
+};
+
+const StrView::size_type StrView::npos;
+
+
+// 按分隔符切分的结果，配合范围for使用：for (StrView field : line.split(','))
+// n个分隔符切出n+1个字段，相邻的分隔符之间是空字段，切分过程中不分配内存
+class StrSplit
+{
+public:
+    class iterator
+    {
+    public:
+        iterator(): next(nullptr), last(nullptr), delim(0), done(true) {}
+        iterator(StrView s, char d): next(s.begin()), last(s.end()), delim(d), done(false) { advance(); }
+
+        const StrView& operator*() const { return field; }
+        const StrView* operator->() const { return &field; }
+        iterator& operator++() { advance(); return *this; }
+        iterator operator++(int) { iterator temp = *this; advance(); return temp; }
+        bool operator==(const iterator& it) const { return done == it.done && (done || field.data() == it.field.data()); }
+        bool operator!=(const iterator& it) const { return !(*this == it); }
+
+    private:
+        void advance();
+
+        const char* next; //下一个字段的开头，最后一个字段切出之后为nullptr
+        const char* last;
+        StrView field;
+        char delim;
+        bool done;
+    };
+
+    StrSplit(StrView s, char d): str(s), delim(d) {}
+    iterator begin() const { return iterator(str, delim); }
+    iterator end() const { return iterator(); }
+
+private:
+    StrView str;
+    char delim;
+};
+
+
+/* 比较运算都定义为非成员函数，这样两边都可以是Str或者const char* */
+
+inline bool operator==(StrView a, StrView b) { return a.size() == b.size() && bytes_equal(a.data(), b.data(), a.size()); }
+inline bool operator!=(StrView a, StrView b) { return !(a == b); }
+inline bool operator<(StrView a, StrView b) { return a.compare(b) < 0; }
+inline bool operator<=(StrView a, StrView b) { return a.compare(b) <= 0; }
+inline bool operator>(StrView a, StrView b) { return a.compare(b) > 0; }
+inline bool operator>=(StrView a, StrView b) { return a.compare(b) >= 0; }
+
+inline ostream& operator<<(ostream& os, StrView s)
+{
+    os.write(s.data(), s.size());
+    return os;
+}
+
+namespace std
+{
+    template<>
+    struct hash<StrView>
+    {
+        size_t operator()(StrView s) const { return s.hash(); }
+    };
+}
+
+
+/* 成员函数的实现 */
+
+inline char StrView::at(size_type n) const
+{
+    if (n >= len)
+        throw "illegal position";
+
+    return ptr[n];
+}
+
+
+// n超出剩余长度时截取到末尾，与标准库一致
+inline StrView StrView::substr(size_type pos, size_type n) const
+{
+    if (pos > len)
+        throw "illegal position";
+
+    return StrView(ptr + pos, min(n, len - pos));
+}
+
+
+inline StrView StrView::ltrim() const
+{
+    const char* b = begin();
+    while (b != end() && isspace(static_cast<unsigned char>(*b)))
+        ++b;
+    return StrView(b, end());
+}
+
+
+inline StrView StrView::rtrim() const
+{
+    const char* e = end();
+    while (e != begin() && isspace(static_cast<unsigned char>(e[-1])))
+        --e;
+    return StrView(begin(), e);
+}
+
+
+inline StrSplit StrView::split(char delim) const
+{
+    return StrSplit(*this, delim);
+}
+
+
+// 先比较公共前缀，前缀相同时较短的更小
+inline int StrView::compare(StrView s) const
+{
+    int r = bytes_compare(ptr, s.ptr, min(len, s.len));
+    if (r != 0)
+        return r;
+
+    return len < s.len ? -1 : (len > s.len ? 1 : 0);
+}
+
+
+inline StrView::size_type StrView::find(char c, size_type pos) const
+{
+    if (pos >= len)
+        return npos;
+
+    size_type k = bytes_find_char(ptr + pos, len - pos, c);
+    return k == npos ? npos : pos + k;
+}
+
+
+inline StrView::size_type StrView::find(StrView s, size_type pos) const
+{
+    if (pos > len)
+        return npos;
+
+    size_type k = bytes_find(ptr + pos, len - pos, s.ptr, s.len);
+    return k == npos ? npos : pos + k;
+}
+
+
+// 与标准库一致，查找起始位置不超过pos的最后一次出现
+inline StrView::size_type StrView::rfind(char c, size_type pos) const
+{
+    if (len == 0)
+        return npos;
+
+    return bytes_rfind_char(ptr, min(pos, len - 1) + 1, c);
+}
+
+
+inline StrView::size_type StrView::rfind(StrView s, size_type pos) const
+{
+    if (s.len > len)
+        return npos;
+
+    return bytes_rfind(ptr, min(pos, len - s.len) + s.len, s.ptr, s.len);
+}
+
+
+inline void StrSplit::iterator::advance()
+{
+    if (next == nullptr)
+    {
+        done = true;
+        return;
+    }
+
+    size_t k = bytes_find_char(next, last - next, delim);
+    if (k == BYTES_NPOS)
+    {
+        field = StrView(next, last);
+        next = nullptr;
+    }
+    else
+    {
+        field = StrView(next, k);
+        next += k + 1;
+    }
+}
+
+
+
+/* 测试代码 */
+
+#if defined(DEBUG) && !defined(NO_MAIN)
+
+int main(int argc, char* argv[])
+{
+    {
+        const char* line = "  id=42, name = bob ,, tail  ";
+        StrView v1(line);
+        assert(v1.size() == strlen(line) && v1.data() == line);
+        StrView v2 = v1.trim();
+        assert(v2 == "id=42, name = bob ,, tail" && v2.data() == line + 2);
+        assert(v2.starts_with("id=") && v2.ends_with("tail") && !v2.starts_with("name"));
+        assert(v2.substr(3, 2) == "42" && v2.substr(21) == "tail" && v2.substr(v2.size()).empty());
+        assert(v2.find(',') == 5 && v2.rfind(',') == 19 && v2.find("name") == 7 && v2.find("nope") == StrView::npos);
+
+        const char* expected[] = { "id=42", "name = bob", "", "tail" };
+        int n = 0;
+        for (StrView field : v2.split(','))
+        {
+            assert(field.trim() == expected[n]);
+            assert(field.data() >= line && field.end() <= line + strlen(line)); //字段都指向原来的缓冲区
+            ++n;
+        }
+        assert(n == 4);
+
+        n = 0;
+        for (StrSplit::iterator it = StrView("").split(',').begin(); it != StrView("").split(',').end(); ++it)
+            ++n;
+        assert(n == 1); //空串切出一个空字段
+        n = 0;
+        for (StrView field : StrView("a,").split(','))
+            n += int(field.size()) + 1;
+        assert(n == 3); //"a"和""
+
+        StrView v3 = "key=value";
+        size_t eq = v3.find('=');
+        StrView key = v3.substr(0, eq), value = v3.substr(eq + 1);
+        assert(key == "key" && value == "value" && key < value && value > key && key != value);
+        v3.remove_prefix(4);
+        v3.remove_suffix(2);
+        assert(v3 == "val");
+        assert(StrView("abc").compare("abcd") < 0 && StrView("abd") >= StrView("abc"));
+        assert(StrView("abc", 2) == "ab" && StrView("abc").at(2) == 'c');
+        assert(std::hash<StrView>()(StrView("key=value").substr(0, 3)) == StrView("key").hash());
+
+        bool thrown = false;
+        try { StrView("abc").substr(4); }
+        catch (const char*) { thrown = true; }
+        assert(thrown);
+    }
+
+    _CrtDumpMemoryLeaks();
+}
+
+#endif // DEBUG
+
+
+/* 性能测试代码 */
+
+#if defined(BENCHMARK) && !defined(NO_MAIN)
+
+#pragma push_macro("NO_MAIN")
+#define NO_MAIN
+#include "Str.cpp"
+#pragma pop_macro("NO_MAIN")
+#include <chrono>
+#include <cstdlib>
+
+static volatile size_t sink; //防止结果被优化掉
+
+double ms_since(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+
+// 解析逗号分隔的记录并去掉字段两端的空白：每个字段拷贝成Str，和直接使用指向原文的StrView比较
+int main(int argc, char* argv[])
+{
+    size_t rows = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000000;
+    StrBuilder sb;
+    for (size_t i = 0; i < rows; ++i)
+        sb << " " << i << ", user_" << i % 1000 << " ,  some longer free-text column " << i % 97 << ",x\n";
+    Str text = sb.release();
+
+    auto start = chrono::steady_clock::now();
+    size_t acc = 0;
+    for (StrView line : StrView(text).split('\n'))
+        for (StrView field : line.split(','))
+        {
+            Str copy(field); //以前substr返回Str时的做法
+            size_t b = 0, e = copy.size();
+            while (b < e && isspace((unsigned char)copy[b]))
+                ++b;
+            while (e > b && isspace((unsigned char)copy[e - 1]))
+                --e;
+            acc += Str(copy.begin() + b, copy.begin() + e).hash();
+        }
+    double copy_ms = ms_since(start);
+    sink = acc;
+
+    start = chrono::steady_clock::now();
+    size_t acc2 = 0;
+    for (StrView line : StrView(text).split('\n'))
+        for (StrView field : line.split(','))
+            acc2 += field.trim().hash();
+    double view_ms = ms_since(start);
+    sink = acc2;
+
+    cout << rows << " rows, " << text.size() << " bytes: Str copies " << copy_ms << " ms, StrView " << view_ms << " ms"
+         << (acc == acc2 ? "" : " (mismatch)") << endl;
+}
+
+#endif // BENCHMARK
+
+#endif // STRVIEW_CPP
@@ -1,356 +1,1112 @@
-#include <memory>
-#include <iostream>
-#include <algorithm>
-#include <string>
-#include <assert.h>
-#include <crtdbg.h>
-
-using namespace std;
-
-#define DEBUG
-
-template<typename T>
-class Vec
-{
-public:
-    typedef T* iterator;
-    typedef const T* const_iterator;
-    typedef size_t size_type;
-    typedef T& ref;
-    typedef const T& const_ref;
-
-private:
-    iterator base;
-    iterator limit;
-    iterator avail;
-
-    allocator<T> alloc; //由于new在分配内存的同时还执行了多余的默认初始化操作，因此我们用allocator类代替
-
-public:
-    Vec() { create();}
-    explicit Vec(size_type n, const_ref val = T()) { create(n, val); }
-    Vec(const Vec& v) { create(v.begin(), v.end());}
-    Vec& operator=(const Vec& v);
-    ~Vec();
-
-    bool empty() const { return base == avail;}
-    iterator begin() { return base; }
-    const_iterator begin() const { return base; }
-    iterator end() { return avail; }
-    const_iterator end() const { return avail; }
-    size_type size() const { return avail - base; }
-    size_type capacity() const { return limit - base; }
-    const_ref front() const { return *base; }
-    const_ref back() const { return *(avail- 1); }
-
-
-    void push_back(const_ref val);
-    void clear();
-    iterator insert(iterator pos, const_ref val);
-    template<typename In>
-    iterator insert(iterator pos, In first, In last);
-    iterator erase(iterator pos);
-    iterator erase(iterator first, iterator last);
-    ref at(size_type n);
-
-    ref operator[](size_type n) {return base[n]; }
-    const_ref operator[](size_type n) const { return base[n]; }
-    bool operator==(const Vec& v);
-
-
-
-private:
-    void create(size_type n = 0, const_ref val = T());
-    void create(const_iterator begin, const_iterator end);
-    void del();
-    void grow();
-};
-
-
-
-/* 公有成员函数的实现 */
-
-template<typename T>
-Vec<T>& Vec<T>::operator=(const Vec& v) //类的作用域运算符之后才不用显式声明<T>
-{
-    if( &v != this)
-    {
-        del(); //如果不加判断，那么当传入对象是自身的时候，在执行删除操作后，传入的v其实也被删除了
-        create(v.begin(), v.end());
-    }
-
-    return *this;
-}
-
-
-template<typename T>
-Vec<T>::~Vec()
-{
-    del();
-}
-
-
-template<typename T>
-void Vec<T>::push_back(const_ref val)
-{
-    if (avail + 1 > limit)
-        grow();
-
-    alloc.construct(avail++, val); //avail指向最后一个元素的后一个地址
-}
-
-
-template<typename T>
-void Vec<T>::clear()
-{
-    auto it = base;
-    while(it != avail)
-        alloc.destroy(it++);
-
-    avail = base;
-}
-
-
-template<typename T>
-typename Vec<T>::iterator Vec<T>::insert(iterator pos, const_ref val)
-{
-    if (pos > avail)
-        throw "illegal input iterator";
-
-    if (pos == avail)
-    {
-        push_back(val);
-        return pos;
-    }
-
-    if (avail + 1 > limit)
-    {
-        int offset = pos - base;
-        grow();
-        pos = base + offset;
-    }
-
-    auto temp = back();
-    alloc.construct(avail++, temp);
-
-    if (pos + 1 != avail)
-    {
-        for(auto i = avail - 3; i >= pos; --i)
-            *(i+1) = *i;
-    }
-
-    *pos = val;
-    return pos;
-}
-
-
-template<typename T>
-template<typename In>
-typename Vec<T>::iterator Vec<T>::insert(iterator pos, In first, In last)
-{
-    if (pos > avail || last <= first)
-        throw "illegal input iterator";
-
-    size_type add = last - first;
-
-    if (avail + add > limit)
-    {
-        int offset = pos - base; // 因为grow后pos迭代器会失效，所以讲迭代器转换为偏移量
-        grow();
-        pos = base + offset;
-    }
-
-    if (pos == avail)
-    {
-        uninitialized_copy(first, last, avail);
-        avail += add;
-        return pos;
-    }
-
-    // 分类讨论
-    size_type remains = avail - pos;
-    if (remains > add)
-    {
-        uninitialized_copy(avail - add, avail, avail);
-        copy_backward(pos, avail - add, avail); // 逆序复制元素
-        copy(first, last, pos);
-    }
-    else
-    {
-        uninitialized_copy(pos, avail, avail + add - remains);
-        copy(first, first + remains, pos);
-        uninitialized_copy(first + remains, last, avail);
-    }
-
-    avail += add;
-    return pos;
-}
-
-
-template<typename T>
-typename Vec<T>::iterator Vec<T>::erase(iterator pos)
-{
-    alloc.destroy(pos);
-    for(auto it = pos + 1 ; it < avail; ++it)
-        *(it - 1) = *it;
-
-    --avail;
-
-    return pos;
-}
-
-
-template<typename T>
-typename Vec<T>::iterator Vec<T>::erase(iterator first, iterator last)
-{
-    if (!(first >= base && last < avail))
-        throw "illegal input iterator";
-
-    for(auto it = first; it != last;++it)
-        alloc.destroy(it);
-
-    size_type minus = last - first;
-
-    for (auto it = last; it < avail; ++it)
-        *(it - minus) = *it;
-
-    avail -= minus;
-
-    return first;
-}
-
-
-template<typename T>
-typename Vec<T>::ref Vec<T>::at(size_type n)
-{
-    if(base + n >= avail)
-        throw "illegal position";
-
-    return base[n];
-}
-
-
-template<typename T>
-bool Vec<T>::operator==(const Vec& v)
-{
-    if (&v == this)
-        return true;
-
-    if (size() != v.size())
-        return false;
-
-    for(size_t i = 0; i < size(); ++i)
-    {
-        if(base[i] != v[i])
-            return false;
-    }
-
-    return true;
-}
-
-
-
-/* 私有成员函数的实现 */
-
-template<typename T>
-void Vec<T>::create(size_type n , const_ref val)
-{
-    if (n == 0)
-        base = limit = avail = nullptr;
-    else
-    {
-        base = alloc.allocate(n); //因为alloc本身已经声明过类型了(T)，所以这里只需用n而不是n*sizeof(T)
-        limit = avail = base + n;
-        uninitialized_fill(base, limit, val);
-    }
-}
-
-
-template<typename T>
-void Vec<T>::create(const_iterator begin, const_iterator end)
-{
-    base = alloc.allocate(end - begin);
-    limit = avail = uninitialized_copy(begin, end, base);
-}
-
-
-template<typename T>
-void Vec<T>::del()
-{
-    if(base != nullptr)
-    {
-        iterator it = limit;
-        while(it != base)
-            alloc.destroy(--it); //destory实际上就是运行了类的析构函数，如果类中存在指针，那么缺少这一步会造成内存泄漏
-
-        alloc.deallocate(base, limit - base);
-        base = limit = avail = nullptr;
-    }
-}
-
-
-template<typename T>
-void Vec<T>::grow()
-{
-    size_type new_size = (base == limit) ? 1 : 2*(limit - base);
-    iterator new_base = alloc.allocate(new_size);
-    iterator new_avail = uninitialized_copy(base, avail, new_base);
-
-    del();
-
-    base = new_base;
-    avail = new_avail;
-    limit = base + new_size;
-}
-
-
-/* 测试代码 */
-
-#ifdef DEBUG
-
-int main(int argc, char* argv[])
-{
-	{
-        Vec<int> v1;
-        Vec<string> v2(5, "hape");
-        Vec<string> v3(v2);
-        Vec<int> v4 = v1;
-
-        assert(v2.size() == 5);
-        v4.push_back(3);
-        assert(!v4.empty());
-        assert(v3.front() == "hape");
-        v2.clear();
-        assert(v2.empty());
-        v4.insert(v4.begin(), 2);
-        v4.insert(v4.begin(), 1);
-        assert(v4[0] == 1 && v4[2] == 3);
-        v1.insert(v1.begin(), v4.begin(), v4.end());
-        assert(v1 == v4);
-        v1.erase(v1.begin());
-        assert(v1.front() == 2);
-        v4.erase(v4.begin(), v4.begin() + 2);
-        assert(v4.front() == 3);
-        Vec<int> v5(10, 1);
-        int a[] = {2,2,2,2,2};
-        v5.insert(v5.begin() + 7, a, a + 5);
-        for(int i = 0; i < 15; i++)
-            cout << v5[i];
-        cout << endl;
-
-        Vec<int> v6(7, 1);
-        int b[] = {2,2,2};
-        v6.insert(v6.begin() + 2, b, b + 3);
-        for(int i = 0; i < 10; i++)
-            cout << v6[i];
-        cout << endl;
-
-	}
-
-	_CrtDumpMemoryLeaks();
-}
-
-#endif // DEBUG
-
-
-
+#ifndef VEC_CPP
+#define VEC_CPP
+
+#include <memory>
+#include <iostream>
+#include <algorithm>
+#include <string>
+#include <assert.h>
+#include <utility>
+#include <type_traits>
+#include <cstring>
+#include <cstdint>
+#include <limits>
+#include <new>
+#include <crtdbg.h>
+
+#pragma push_macro("NO_MAIN")
+#define NO_MAIN
+#include "Simd.cpp"
+#pragma pop_macro("NO_MAIN")
+
+using namespace std;
+
+#ifndef BENCHMARK
+#define DEBUG
+#endif
+
+
+// 可平凡重定位：把对象的字节原样搬到新地址，等价于"在新地址移动构造 + 析构旧对象"
+// 平凡可拷贝的类型一定满足，其余类型只要不保存指向自身的指针（如Vec、Str），可以特化此模板声明
+// 声明为可重定位的类型，其移动构造函数也不应抛出异常
+template<typename T>
+struct trivially_relocatable : is_trivially_copyable<T> {};
+
+// 逐字节相等即值相等：整数、枚举和指针满足；浮点数（+0与-0、NaN）和可能含填充字节的结构体不满足
+template<typename T>
+struct bytewise_comparable : integral_constant<bool, is_integral<T>::value || is_enum<T>::value || is_pointer<T>::value> {};
+
+
+// 扩容策略：根据当前容量和至少需要的容量，给出新的容量（以元素个数计）
+// 返回值必须不小于required，这样批量插入时只需分配一次内存
+
+// 每次容量翻倍，摊还代价最低，但最多会浪费一半的内存
+struct DoubleGrowth
+{
+    static size_t next(size_t capacity, size_t required, size_t elem_size)
+    {
+        size_t max_size = numeric_limits<size_t>::max() / elem_size;
+        size_t doubled = capacity > max_size / 2 ? max_size : (capacity == 0 ? 1 : 2 * capacity);
+        return max(doubled, required);
+    }
+};
+
+
+// 每次扩大1.5倍，释放掉的旧内存块之和有机会被之后的分配复用
+struct OneAndHalfGrowth
+{
+    static size_t next(size_t capacity, size_t required, size_t elem_size)
+    {
+        size_t max_size = numeric_limits<size_t>::max() / elem_size;
+        size_t grown = capacity > max_size - capacity / 2 ? max_size : capacity + max<size_t>(capacity / 2, 1);
+        return max(grown, required);
+    }
+};
+
+
+// 在1.5倍的基础上，把字节数向上取整到jemalloc的size class，分配器多给的那部分内存也能用上
+// size class: 8, 16, 32, 48, ..., 128，之后每个2的幂区间再均分为4档，如 160, 192, 224, 256, 320 ...
+struct SizeClassGrowth
+{
+    static size_t next(size_t capacity, size_t required, size_t elem_size)
+    {
+        size_t count = OneAndHalfGrowth::next(capacity, required, elem_size);
+        if (count > (numeric_limits<size_t>::max() / 2) / elem_size)
+            return count; //已经接近上限，不再取整
+
+        return size_class(count * elem_size) / elem_size;
+    }
+
+    static size_t size_class(size_t bytes)
+    {
+        if (bytes <= 8)
+            return 8;
+        if (bytes <= 128)
+            return (bytes + 15) & ~size_t(15);
+
+        size_t lg = 0; // 2^lg < bytes <= 2^(lg+1)
+        while ((size_t(1) << (lg + 1)) < bytes)
+            ++lg;
+        size_t delta = size_t(1) << (lg - 2); // 每个区间4档，间隔为2^lg/4
+        return (bytes + delta - 1) & ~(delta - 1);
+    }
+};
+
+
+template<typename T, typename Growth = DoubleGrowth, typename Alloc = allocator<T> >
+class Vec
+{
+public:
+    typedef Alloc allocator_type;
+    typedef T* iterator;
+    typedef const T* const_iterator;
+    typedef size_t size_type;
+    typedef T& ref;
+    typedef const T& const_ref;
+
+private:
+    iterator base;
+    iterator limit;
+    iterator avail;
+
+    Alloc alloc; //由于new在分配内存的同时还执行了多余的默认初始化操作，因此我们用allocator类代替
+    // 所有内存操作都经过allocator_traits，这样只实现了allocate/deallocate的分配器也能使用
+    typedef allocator_traits<Alloc> alloc_traits;
+
+public:
+    Vec(): base(nullptr), limit(nullptr), avail(nullptr) {} //不调用create()，避免要求T有默认构造函数
+    explicit Vec(const Alloc& a): base(nullptr), limit(nullptr), avail(nullptr), alloc(a) {}
+    explicit Vec(size_type n, const_ref val = T(), const Alloc& a = Alloc()): alloc(a) { create(n, val); }
+    Vec(const Vec& v): alloc(alloc_traits::select_on_container_copy_construction(v.alloc)) { create(v.begin(), v.end());}
+    Vec(Vec&& v) noexcept : base(v.base), limit(v.limit), avail(v.avail), alloc(std::move(v.alloc)) { v.base = v.limit = v.avail = nullptr; } //直接接管v的内存，不拷贝元素
+    Vec& operator=(const Vec& v);
+    Vec& operator=(Vec&& v) noexcept(alloc_traits::propagate_on_container_move_assignment::value);
+    ~Vec();
+
+    allocator_type get_allocator() const { return alloc; }
+
+    bool empty() const { return base == avail;}
+    iterator begin() { return base; }
+    const_iterator begin() const { return base; }
+    iterator end() { return avail; }
+    const_iterator end() const { return avail; }
+    size_type size() const { return avail - base; }
+    size_type capacity() const { return limit - base; }
+    size_type max_size() const { return numeric_limits<size_type>::max() / sizeof(T); }
+    const_ref front() const { return *base; }
+    const_ref back() const { return *(avail- 1); }
+
+
+    void push_back(const_ref val);
+    void push_back(T&& val);
+    template<typename... Args>
+    void emplace_back(Args&&... args);
+    void clear();
+    void reserve(size_type n);
+    void shrink_to_fit();
+    void resize(size_type n);
+    void resize(size_type n, const_ref val);
+    iterator insert(iterator pos, const_ref val);
+    iterator insert(iterator pos, T&& val);
+    template<typename... Args>
+    iterator emplace(iterator pos, Args&&... args);
+    template<typename In>
+    iterator insert(iterator pos, In first, In last);
+    iterator erase(iterator pos);
+    iterator erase(iterator first, iterator last);
+    ref at(size_type n);
+
+    ref operator[](size_type n) {return base[n]; }
+    const_ref operator[](size_type n) const { return base[n]; }
+    bool operator==(const Vec& v) const;
+
+
+
+private:
+    void create(size_type n = 0, const_ref val = T());
+    void create(const_iterator begin, const_iterator end);
+    void del();
+    void grow(size_type required);
+    void reallocate(size_type new_size);
+    iterator uninitialized_move_if_noexcept(iterator first, iterator last, iterator dest);
+
+    // 以下函数在编译期按类型特征分派，true_type版本直接用memcpy/memmove整块搬运，或者跳过析构
+    typedef trivially_relocatable<T> relocatable;
+    typedef is_trivially_destructible<T> trivial_dtor;
+
+    iterator relocate(iterator first, iterator last, iterator dest, true_type);
+    iterator relocate(iterator first, iterator last, iterator dest, false_type);
+    void destroy(iterator first, iterator last) { destroy(first, last, trivial_dtor()); }
+    void destroy(iterator, iterator, true_type) {}
+    void destroy(iterator first, iterator last, false_type);
+    void insert_one(iterator pos, T&& val, true_type);
+    void insert_one(iterator pos, T&& val, false_type);
+    template<typename In>
+    void insert_range(iterator pos, In first, In last, true_type);
+    template<typename In>
+    void insert_range(iterator pos, In first, In last, false_type);
+    void erase_range(iterator first, iterator last, true_type);
+    void erase_range(iterator first, iterator last, false_type);
+    bool equal_elements(const Vec& v, true_type) const;
+    bool equal_elements(const Vec& v, false_type) const;
+
+    // 按分配器的propagate_on_container_*分派
+    void assign_alloc(const Alloc& a, true_type) { alloc = a; }
+    void assign_alloc(const Alloc&, false_type) {}
+    void move_assign(Vec& v, true_type);
+    void move_assign(Vec& v, false_type);
+    void steal(Vec& v);
+};
+
+
+
+/* 公有成员函数的实现 */
+
+template<typename T, typename Growth, typename Alloc>
+Vec<T, Growth, Alloc>& Vec<T, Growth, Alloc>::operator=(const Vec& v) //类的作用域运算符之后才不用显式声明<T>
+{
+    if( &v != this)
+    {
+        del(); //如果不加判断，那么当传入对象是自身的时候，在执行删除操作后，传入的v其实也被删除了
+        assign_alloc(v.alloc, typename alloc_traits::propagate_on_container_copy_assignment()); //先用旧的分配器释放，再换成新的
+        create(v.begin(), v.end());
+    }
+
+    return *this;
+}
+
+
+template<typename T, typename Growth, typename Alloc>
+Vec<T, Growth, Alloc>& Vec<T, Growth, Alloc>::operator=(Vec&& v) noexcept(alloc_traits::propagate_on_container_move_assignment::value)
+{
+    if (&v != this)
+        move_assign(v, typename alloc_traits::propagate_on_container_move_assignment());
+
+    return *this;
+}
+
+
+template<typename T, typename Growth, typename Alloc>
+Vec<T, Growth, Alloc>::~Vec()
+{
+    del();
+}
+
+
+template<typename T, typename Growth, typename Alloc>
+void Vec<T, Growth, Alloc>::push_back(const_ref val)
+{
+    emplace_back(val);
+}
+
+
+template<typename T, typename Growth, typename Alloc>
+void Vec<T, Growth, Alloc>::push_back(T&& val)
+{
+    emplace_back(std::move(val));
+}
+
+
+template<typename T, typename Growth, typename Alloc>
+template<typename... Args>
+void Vec<T, Growth, Alloc>::emplace_back(Args&&... args)
+{
+    if (avail + 1 > limit)
+    {
+        // args可能引用的是本容器中的元素，grow之后就失效了，所以先构造出临时对象
+        T temp(std::forward<Args>(args)...);
+        grow(size() + 1);
+        alloc_traits::construct(alloc, avail++, std::move(temp));
+        return;
+    }
+
+    alloc_traits::construct(alloc, avail++, std::forward<Args>(args)...); //直接在avail处构造，省去一次拷贝
+}
+
+
+template<typename T, typename Growth, typename Alloc>
+void Vec<T, Growth, Alloc>::clear()
+{
+    destroy(base, avail);
+    avail = base;
+}
+
+
+template<typename T, typename Growth, typename Alloc>
+void Vec<T, Growth, Alloc>::reserve(size_type n)
+{
+    if (n > max_size())
+        throw "Vec too long";
+
+    if (n > capacity())
+        reallocate(n); //预留的容量按用户要求精确分配，不走扩容策略
+}
+
+
+template<typename T, typename Growth, typename Alloc>
+void Vec<T, Growth, Alloc>::shrink_to_fit()
+{
+    if (avail == limit)
+        return;
+
+    if (empty())
+        del();
+    else
+        reallocate(size());
+}
+
+
+template<typename T, typename Growth, typename Alloc>
+void Vec<T, Growth, Alloc>::resize(size_type n)
+{
+    if (n <= size())
+    {
+        destroy(base + n, avail);
+        avail = base + n;
+        return;
+    }
+
+    if (n > capacity())
+        grow(n);
+
+    for (; avail != base + n; ++avail)
+        alloc_traits::construct(alloc, avail); //值初始化，int等类型会被置0
+}
+
+
+template<typename T, typename Growth, typename Alloc>
+void Vec<T, Growth, Alloc>::resize(size_type n, const_ref val)
+{
+    if (n <= size())
+    {
+        destroy(base + n, avail);
+        avail = base + n;
+        return;
+    }
+
+    if (n > capacity())
+    {
+        T temp(val); // val可能是本容器中的元素
+        grow(n);
+        uninitialized_fill(avail, base + n, temp);
+    }
+    else
+        uninitialized_fill(avail, base + n, val);
+
+    avail = base + n;
+}
+
+
+template<typename T, typename Growth, typename Alloc>
+typename Vec<T, Growth, Alloc>::iterator Vec<T, Growth, Alloc>::insert(iterator pos, const_ref val)
+{
+    return emplace(pos, val);
+}
+
+
+template<typename T, typename Growth, typename Alloc>
+typename Vec<T, Growth, Alloc>::iterator Vec<T, Growth, Alloc>::insert(iterator pos, T&& val)
+{
+    return emplace(pos, std::move(val));
+}
+
+
+template<typename T, typename Growth, typename Alloc>
+template<typename... Args>
+typename Vec<T, Growth, Alloc>::iterator Vec<T, Growth, Alloc>::emplace(iterator pos, Args&&... args)
+{
+    if (pos > avail || pos < base)
+        throw "illegal input iterator";
+
+    size_type offset = pos - base;
+
+    if (pos == avail)
+    {
+        emplace_back(std::forward<Args>(args)...);
+        return base + offset; // push_back可能触发grow，原来的pos已经失效
+    }
+
+    T temp(std::forward<Args>(args)...); //同emplace_back，防止args引用的元素在移动过程中被改变
+
+    if (avail + 1 > limit)
+    {
+        grow(size() + 1);
+        pos = base + offset;
+    }
+
+    insert_one(pos, std::move(temp), relocatable());
+    return pos;
+}
+
+
+template<typename T, typename Growth, typename Alloc>
+template<typename In>
+typename Vec<T, Growth, Alloc>::iterator Vec<T, Growth, Alloc>::insert(iterator pos, In first, In last)
+{
+    if (pos > avail || last < first)
+        throw "illegal input iterator";
+
+    if (first == last)
+        return pos;
+
+    size_type add = last - first;
+
+    if (add > capacity() - size())
+    {
+        size_type offset = pos - base; // 因为grow后pos迭代器会失效，所以讲迭代器转换为偏移量
+        grow(size() + add); //一次扩到足够容纳全部新元素，而不是只翻倍一次
+        pos = base + offset;
+    }
+
+    if (pos == avail)
+    {
+        uninitialized_copy(first, last, avail);
+        avail += add;
+        return pos;
+    }
+
+    insert_range(pos, first, last, relocatable());
+    return pos;
+}
+
+
+template<typename T, typename Growth, typename Alloc>
+typename Vec<T, Growth, Alloc>::iterator Vec<T, Growth, Alloc>::erase(iterator pos)
+{
+    erase_range(pos, pos + 1, relocatable());
+    return pos;
+}
+
+
+template<typename T, typename Growth, typename Alloc>
+typename Vec<T, Growth, Alloc>::iterator Vec<T, Growth, Alloc>::erase(iterator first, iterator last)
+{
+    if (!(first >= base && first <= last && last <= avail))
+        throw "illegal input iterator";
+
+    erase_range(first, last, relocatable());
+    return first;
+}
+
+
+template<typename T, typename Growth, typename Alloc>
+typename Vec<T, Growth, Alloc>::ref Vec<T, Growth, Alloc>::at(size_type n)
+{
+    if(base + n >= avail)
+        throw "illegal position";
+
+    return base[n];
+}
+
+
+template<typename T, typename Growth, typename Alloc>
+bool Vec<T, Growth, Alloc>::operator==(const Vec& v) const
+{
+    if (&v == this)
+        return true;
+
+    if (size() != v.size())
+        return false;
+
+    return equal_elements(v, bytewise_comparable<T>());
+}
+
+
+
+/* 私有成员函数的实现 */
+
+template<typename T, typename Growth, typename Alloc>
+void Vec<T, Growth, Alloc>::create(size_type n , const_ref val)
+{
+    if (n == 0)
+        base = limit = avail = nullptr;
+    else
+    {
+        base = alloc_traits::allocate(alloc, n); //因为alloc本身已经声明过类型了(T)，所以这里只需用n而不是n*sizeof(T)
+        limit = avail = base + n;
+        uninitialized_fill(base, limit, val);
+    }
+}
+
+
+template<typename T, typename Growth, typename Alloc>
+void Vec<T, Growth, Alloc>::create(const_iterator begin, const_iterator end)
+{
+    base = alloc_traits::allocate(alloc, end - begin);
+    limit = avail = uninitialized_copy(begin, end, base);
+}
+
+
+template<typename T, typename Growth, typename Alloc>
+void Vec<T, Growth, Alloc>::del()
+{
+    if(base != nullptr)
+    {
+        destroy(base, avail); //[avail, limit)之间的内存并没有构造对象，不能析构
+        alloc_traits::deallocate(alloc, base, limit - base);
+        base = limit = avail = nullptr;
+    }
+}
+
+
+// 按扩容策略扩大容量，保证至少能容纳required个元素
+template<typename T, typename Growth, typename Alloc>
+void Vec<T, Growth, Alloc>::grow(size_type required)
+{
+    if (required > max_size())
+        throw "Vec too long";
+
+    reallocate(min(Growth::next(capacity(), required, sizeof(T)), max_size()));
+}
+
+
+template<typename T, typename Growth, typename Alloc>
+void Vec<T, Growth, Alloc>::reallocate(size_type new_size)
+{
+    iterator new_base = alloc_traits::allocate(alloc, new_size);
+    iterator new_avail;
+
+    try
+    {
+        new_avail = relocate(base, avail, new_base, relocatable());
+    }
+    catch(...)
+    {
+        alloc_traits::deallocate(alloc, new_base, new_size); //旧的元素没有被改动，直接丢弃新内存即可
+        throw;
+    }
+
+    if (base != nullptr)
+        alloc_traits::deallocate(alloc, base, limit - base); //旧内存中的元素已经在relocate中被搬走或析构
+
+    base = new_base;
+    avail = new_avail;
+    limit = base + new_size;
+}
+
+
+// 如果T的移动构造函数不会抛出异常，就把元素移动到新内存，否则仍然拷贝
+// 因为移动到一半时抛出异常的话，旧内存里的元素已经被破坏，无法回滚
+template<typename T, typename Growth, typename Alloc>
+typename Vec<T, Growth, Alloc>::iterator Vec<T, Growth, Alloc>::uninitialized_move_if_noexcept(iterator first, iterator last, iterator dest)
+{
+    iterator cur = dest;
+    try
+    {
+        for (; first != last; ++first, ++cur)
+            alloc_traits::construct(alloc, cur, std::move_if_noexcept(*first));
+    }
+    catch(...)
+    {
+        while (cur != dest)
+            alloc_traits::destroy(alloc, --cur);
+        throw;
+    }
+
+    return cur;
+}
+
+
+// 把[first, last)搬到未初始化的dest处，搬运之后源区间不再含有对象
+template<typename T, typename Growth, typename Alloc>
+typename Vec<T, Growth, Alloc>::iterator Vec<T, Growth, Alloc>::relocate(iterator first, iterator last, iterator dest, true_type)
+{
+    if (first != last)
+        memcpy(static_cast<void*>(dest), static_cast<const void*>(first), (last - first) * sizeof(T));
+
+    return dest + (last - first);
+}
+
+
+template<typename T, typename Growth, typename Alloc>
+typename Vec<T, Growth, Alloc>::iterator Vec<T, Growth, Alloc>::relocate(iterator first, iterator last, iterator dest, false_type)
+{
+    iterator new_last = uninitialized_move_if_noexcept(first, last, dest);
+    destroy(first, last);
+    return new_last;
+}
+
+
+template<typename T, typename Growth, typename Alloc>
+void Vec<T, Growth, Alloc>::destroy(iterator first, iterator last, false_type)
+{
+    while (last != first)
+        alloc_traits::destroy(alloc, --last); //destory实际上就是运行了类的析构函数，如果类中存在指针，那么缺少这一步会造成内存泄漏
+}
+
+
+// 以下insert/erase的辅助函数调用时都已保证容量足够、迭代器合法
+template<typename T, typename Growth, typename Alloc>
+void Vec<T, Growth, Alloc>::insert_one(iterator pos, T&& val, true_type)
+{
+    memmove(static_cast<void*>(pos + 1), static_cast<const void*>(pos), (avail - pos) * sizeof(T));
+    ++avail;
+    alloc_traits::construct(alloc, pos, std::move(val)); //pos处的字节已经被搬走，视为未初始化内存
+}
+
+
+template<typename T, typename Growth, typename Alloc>
+void Vec<T, Growth, Alloc>::insert_one(iterator pos, T&& val, false_type)
+{
+    alloc_traits::construct(alloc, avail, std::move(*(avail - 1)));
+    move_backward(pos, avail - 1, avail); //元素依次后移一位，用移动代替拷贝
+    ++avail;
+
+    *pos = std::move(val);
+}
+
+
+template<typename T, typename Growth, typename Alloc>
+template<typename In>
+void Vec<T, Growth, Alloc>::insert_range(iterator pos, In first, In last, true_type)
+{
+    size_type add = last - first;
+    memmove(static_cast<void*>(pos + add), static_cast<const void*>(pos), (avail - pos) * sizeof(T));
+    uninitialized_copy(first, last, pos);
+    avail += add;
+}
+
+
+template<typename T, typename Growth, typename Alloc>
+template<typename In>
+void Vec<T, Growth, Alloc>::insert_range(iterator pos, In first, In last, false_type)
+{
+    size_type add = last - first;
+
+    // 分类讨论
+    size_type remains = avail - pos;
+    if (remains > add)
+    {
+        uninitialized_copy(make_move_iterator(avail - add), make_move_iterator(avail), avail);
+        move_backward(pos, avail - add, avail); // 逆序移动元素
+        copy(first, last, pos);
+    }
+    else
+    {
+        uninitialized_copy(make_move_iterator(pos), make_move_iterator(avail), avail + add - remains);
+        copy(first, first + remains, pos);
+        uninitialized_copy(first + remains, last, avail);
+    }
+
+    avail += add;
+}
+
+
+template<typename T, typename Growth, typename Alloc>
+void Vec<T, Growth, Alloc>::erase_range(iterator first, iterator last, true_type)
+{
+    destroy(first, last);
+    memmove(static_cast<void*>(first), static_cast<const void*>(last), (avail - last) * sizeof(T));
+    avail -= last - first;
+}
+
+
+template<typename T, typename Growth, typename Alloc>
+void Vec<T, Growth, Alloc>::erase_range(iterator first, iterator last, false_type)
+{
+    // 先把后面的元素前移，再析构末尾已被移走的元素
+    // 如果先析构[first, last)，之后再对其赋值就是在对已析构的对象操作
+    iterator new_avail = std::move(last, avail, first);
+    destroy(new_avail, avail);
+    avail = new_avail;
+}
+
+
+// 整块内存交给向量化的bytes_equal比较，调用前已确认两者长度相同
+template<typename T, typename Growth, typename Alloc>
+bool Vec<T, Growth, Alloc>::equal_elements(const Vec& v, true_type) const
+{
+    return bytes_equal(reinterpret_cast<const char*>(base), reinterpret_cast<const char*>(v.base), size() * sizeof(T));
+}
+
+
+template<typename T, typename Growth, typename Alloc>
+bool Vec<T, Growth, Alloc>::equal_elements(const Vec& v, false_type) const
+{
+    for(size_t i = 0; i < size(); ++i)
+    {
+        if(!(base[i] == v.base[i]))
+            return false;
+    }
+
+    return true;
+}
+
+
+// 分配器随内存一起转移，直接接管v的内存
+template<typename T, typename Growth, typename Alloc>
+void Vec<T, Growth, Alloc>::move_assign(Vec& v, true_type)
+{
+    del();
+    alloc = std::move(v.alloc);
+    steal(v);
+}
+
+
+// 分配器不随之转移，如果两个分配器不相等，v的内存不能由本对象的分配器释放，只能逐个移动元素
+template<typename T, typename Growth, typename Alloc>
+void Vec<T, Growth, Alloc>::move_assign(Vec& v, false_type)
+{
+    del();
+    if (alloc == v.alloc)
+    {
+        steal(v);
+        return;
+    }
+
+    reserve(v.size());
+    avail = uninitialized_copy(make_move_iterator(v.begin()), make_move_iterator(v.end()), base);
+    v.clear();
+}
+
+
+template<typename T, typename Growth, typename Alloc>
+void Vec<T, Growth, Alloc>::steal(Vec& v)
+{
+    base = v.base;
+    limit = v.limit;
+    avail = v.avail;
+    v.base = v.limit = v.avail = nullptr; //v仍需处于可析构的状态
+}
+
+
+// Vec只保存指向堆内存的指针和分配器，分配器是空类或者本身可平凡重定位时，整体搬运不会破坏任何不变式
+// 有状态的分配器可能保存指向自身的指针，这时Vec<Vec<T, G, A> >扩容必须逐个移动
+template<typename T, typename Growth, typename Alloc>
+struct trivially_relocatable<Vec<T, Growth, Alloc> > : integral_constant<bool, is_empty<Alloc>::value || trivially_relocatable<Alloc>::value> {};
+
+
+
+/* Arena分配器 */
+
+// 单调增长的内存池：分配时只移动指针，单个对象的释放什么都不做，reset()时一次性归还所有内存
+// 适合生命周期相同的一批容器，比如一次请求中创建的所有Vec，请求结束后reset即可
+class Arena
+{
+public:
+    explicit Arena(size_t block_size = 4096): head(nullptr), cur(nullptr), limit(nullptr), next_size(block_size) {}
+    ~Arena() { release(head); }
+
+    void* allocate(size_t bytes, size_t align)
+    {
+        size_t pad = (align - reinterpret_cast<uintptr_t>(cur) % align) % align;
+        if (cur == nullptr || bytes + pad > size_t(limit - cur))
+        {
+            add_block(bytes + align);
+            pad = (align - reinterpret_cast<uintptr_t>(cur) % align) % align;
+        }
+
+        char* p = cur + pad;
+        cur = p + bytes;
+        return p;
+    }
+
+    // 只保留最近分配的块（也是最大的块），其余块全部释放，之后的分配从头复用这个块
+    // reset之后，之前从arena分配出去的内存全部失效
+    void reset()
+    {
+        if (head == nullptr)
+            return;
+
+        release(head->next);
+        head->next = nullptr;
+        cur = reinterpret_cast<char*>(head + 1);
+        limit = cur + head->size;
+    }
+
+private:
+    struct Block
+    {
+        Block* next;
+        size_t size; //不含Block头部的可用字节数
+    };
+
+    Block* head;
+    char* cur;
+    char* limit;
+    size_t next_size;
+
+    Arena(const Arena&);
+    Arena& operator=(const Arena&);
+
+    void add_block(size_t min_size)
+    {
+        size_t size = max(next_size, min_size);
+        Block* block = static_cast<Block*>(::operator new(sizeof(Block) + size));
+        block->next = head;
+        block->size = size;
+        head = block;
+        cur = reinterpret_cast<char*>(block + 1);
+        limit = cur + size;
+        next_size = size * 2; //块的大小按几何级数增长，reset之后保留的块足以容纳一整次请求
+    }
+
+    static void release(Block* block)
+    {
+        while (block != nullptr)
+        {
+            Block* next = block->next;
+            ::operator delete(block);
+            block = next;
+        }
+    }
+};
+
+
+// 从Arena中分配内存的分配器，只保存一个指向Arena的指针
+// 和std::pmr一样，容器拷贝、赋值、交换时分配器都不随之转移，元素始终留在各自的Arena里
+template<typename T>
+class ArenaAllocator
+{
+public:
+    typedef T value_type;
+    typedef false_type propagate_on_container_copy_assignment;
+    typedef false_type propagate_on_container_move_assignment;
+    typedef false_type propagate_on_container_swap;
+
+    explicit ArenaAllocator(Arena& a) noexcept : arena(&a) {}
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) noexcept : arena(other.arena) {}
+
+    T* allocate(size_t n)
+    {
+        if (n > numeric_limits<size_t>::max() / sizeof(T))
+            throw bad_alloc();
+        return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T*, size_t) noexcept {} //内存由Arena统一回收
+
+    template<typename U>
+    bool operator==(const ArenaAllocator<U>& other) const { return arena == other.arena; }
+    template<typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const { return arena != other.arena; }
+
+private:
+    template<typename U>
+    friend class ArenaAllocator;
+
+    Arena* arena;
+};
+
+// 只保存一个指向Arena的指针
+template<typename T>
+struct trivially_relocatable<ArenaAllocator<T> > : true_type {};
+
+
+/* 测试代码 */
+
+// 被其他文件include时，定义NO_MAIN来跳过这里的测试代码和性能测试代码
+#if defined(DEBUG) && !defined(NO_MAIN)
+
+// 拷贝时记录自己的地址，不能按字节搬运
+template<typename T>
+struct SelfRefAlloc : allocator<T>
+{
+    SelfRefAlloc(): self(this) {}
+    SelfRefAlloc(const SelfRefAlloc&): self(this) {}
+    const SelfRefAlloc* self;
+};
+
+int main(int argc, char* argv[])
+{
+	{
+        Vec<int> v1;
+        Vec<string> v2(5, "hape");
+        Vec<string> v3(v2);
+        Vec<int> v4 = v1;
+
+        assert(v2.size() == 5);
+        v4.push_back(3);
+        assert(!v4.empty());
+        assert(v3.front() == "hape");
+        v2.clear();
+        assert(v2.empty());
+        v4.insert(v4.begin(), 2);
+        v4.insert(v4.begin(), 1);
+        assert(v4[0] == 1 && v4[2] == 3);
+        v1.insert(v1.begin(), v4.begin(), v4.end());
+        assert(v1 == v4);
+        v1.erase(v1.begin());
+        assert(v1.front() == 2);
+        v4.erase(v4.begin(), v4.begin() + 2);
+        assert(v4.front() == 3);
+        Vec<int> v5(10, 1);
+        int a[] = {2,2,2,2,2};
+        v5.insert(v5.begin() + 7, a, a + 5);
+        for(int i = 0; i < 15; i++)
+            cout << v5[i];
+        cout << endl;
+
+        Vec<int> v6(7, 1);
+        int b[] = {2,2,2};
+        v6.insert(v6.begin() + 2, b, b + 3);
+        for(int i = 0; i < 10; i++)
+            cout << v6[i];
+        cout << endl;
+
+        Vec<string> v7;
+        string s1 = "move me";
+        v7.push_back(std::move(s1));
+        v7.emplace_back(3, 'a');
+        v7.emplace(v7.begin(), "first");
+        v7.push_back(v7[0]); // 引用自身元素时触发grow
+        assert(v7.size() == 4 && v7[0] == "first" && v7[1] == "move me" && v7[2] == "aaa" && v7[3] == "first");
+        Vec<string> v8(std::move(v7));
+        assert(v7.empty() && v8.size() == 4);
+        v7 = std::move(v8);
+        assert(v8.empty() && v7.back() == "first");
+        v7.erase(v7.begin() + 1, v7.end());
+        assert(v7.size() == 1 && v7.front() == "first");
+
+        Vec<Vec<int> > v9; // Vec<int>声明了可平凡重定位，grow时直接memcpy
+        for (int i = 0; i < 5; ++i)
+            v9.push_back(Vec<int>(i + 1, i));
+        v9.erase(v9.begin() + 1);
+        v9.insert(v9.begin(), Vec<int>(2, 7));
+        assert(v9.size() == 5 && v9[0][1] == 7 && v9[1].size() == 1 && v9[2][2] == 2 && v9[4][4] == 4);
+        v9.erase(v9.begin(), v9.begin() + 2);
+        assert(v9.front().size() == 3);
+
+        Vec<int> v10;
+        v10.reserve(100);
+        assert(v10.capacity() == 100 && v10.empty());
+        v10.insert(v10.end(), a, a + 5);
+        v10.resize(8);
+        assert(v10.size() == 8 && v10[4] == 2 && v10[7] == 0);
+        v10.resize(3, 9);
+        assert(v10.size() == 3 && v10.back() == 2);
+        v10.shrink_to_fit();
+        assert(v10.capacity() == 3);
+        v10.resize(6, v10[0]);
+        assert(v10.size() == 6 && v10[5] == 2);
+        v10.insert(v10.begin() + 1, v5.begin(), v5.end()); // 一次扩容容纳所有新元素
+        assert(v10.size() == 21 && v10[1] == 1 && v10[8] == 2 && v10[16] == 2);
+
+        Vec<int, OneAndHalfGrowth> v11;
+        for (int i = 0; i < 10; ++i)
+            v11.push_back(i);
+        assert(v11.capacity() == 13 && v11[9] == 9);
+        Vec<int, SizeClassGrowth> v12(1, 0);
+        v12.push_back(1);
+        assert(v12.capacity() == 2); // 8字节的size class
+        assert(SizeClassGrowth::size_class(129) == 160 && SizeClassGrowth::size_class(257) == 320);
+
+        Arena arena1(64), arena2(64);
+        typedef Vec<string, DoubleGrowth, ArenaAllocator<string> > ArenaVec;
+        ArenaVec v13((ArenaAllocator<string>(arena1)));
+        for (int i = 0; i < 20; ++i)
+            v13.push_back(string(i, 'x'));
+        ArenaVec v14(v13); // 拷贝构造沿用v13的arena
+        assert(v14.get_allocator() == v13.get_allocator() && v14[19].size() == 19);
+        ArenaVec v15((ArenaAllocator<string>(arena2)));
+        v15 = std::move(v13); // 分配器不相等，逐个移动元素，v15仍在arena2中
+        assert(v15.get_allocator() == ArenaAllocator<string>(arena2) && v15.size() == 20 && v13.empty());
+        v15 = v14;
+        assert(v15.get_allocator() != v14.get_allocator() && v15[10] == v14[10]);
+        v15.clear();
+        v14.clear();
+        arena1.reset();
+        Vec<int, DoubleGrowth, ArenaAllocator<int> > v16(3, 1, ArenaAllocator<int>(arena1));
+        v16.insert(v16.end(), a, a + 5);
+        assert(v16.size() == 8 && v16[7] == 2);
+
+        // 只有分配器也能按字节搬运时，Vec本身才是可平凡重定位的
+        static_assert(trivially_relocatable<Vec<string> >::value, "std::allocator is empty");
+        static_assert(trivially_relocatable<ArenaVec>::value, "ArenaAllocator only holds a pointer");
+        static_assert(!trivially_relocatable<Vec<int, DoubleGrowth, SelfRefAlloc<int> > >::value, "self-referencing allocator");
+
+        Vec<int> v17(100, 7), v18(100, 7); // 整数按字节整块比较
+        assert(v17 == v18);
+        v18[99] = 8;
+        assert(!(v17 == v18));
+        Vec<double> v19(3, 0.0), v20(3, -0.0); // 浮点数仍逐个用==比较，+0与-0相等
+        assert(v19 == v20);
+	}
+
+	_CrtDumpMemoryLeaks();
+}
+
+#endif // DEBUG
+
+
+/* 性能测试代码 */
+
+#if defined(BENCHMARK) && !defined(NO_MAIN)
+
+#include <chrono>
+#include <cstdlib>
+#include <new>
+
+// 统计全局operator new的调用次数，string的内存和Vec本身的内存都会经过这里
+static size_t alloc_count = 0;
+
+void* operator new(size_t n)
+{
+    ++alloc_count;
+    if (void* p = malloc(n))
+        return p;
+    throw bad_alloc();
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+
+// 移动构造函数没有声明noexcept，grow时move_if_noexcept会退化为拷贝，相当于改动之前的行为
+struct CopyOnGrowString
+{
+    string s;
+
+    CopyOnGrowString(const string& str): s(str) {}
+    CopyOnGrowString(const CopyOnGrowString& other): s(other.s) {}
+    CopyOnGrowString(CopyOnGrowString&& other): s(std::move(other.s)) {}
+    CopyOnGrowString& operator=(const CopyOnGrowString& other) { s = other.s; return *this; }
+    CopyOnGrowString& operator=(CopyOnGrowString&& other) { s = std::move(other.s); return *this; }
+};
+
+
+template<typename S>
+void bench_grow(const char* name, size_t n)
+{
+    string payload(64, 'x'); //超过SSO的长度，保证每个string都有自己的堆内存
+
+    alloc_count = 0;
+    auto start = chrono::steady_clock::now();
+    {
+        Vec<S> v;
+        for (size_t i = 0; i < n; ++i)
+            v.push_back(S(payload));
+    }
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    cout << name << ": " << n << " push_back, " << alloc_count << " allocations, " << ms << " ms" << endl;
+}
+
+
+template<typename Growth>
+void bench_growth_policy(const char* name, size_t n)
+{
+    alloc_count = 0;
+    auto start = chrono::steady_clock::now();
+    Vec<int, Growth> v;
+    for (size_t i = 0; i < n; ++i)
+        v.push_back(int(i));
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    cout << name << ": " << alloc_count << " allocations, capacity/size = "
+         << double(v.capacity()) / v.size() << ", " << ms << " ms" << endl;
+}
+
+
+void bench_bulk_insert(size_t n)
+{
+    Vec<int> src(n, 1);
+
+    alloc_count = 0;
+    Vec<int> v;
+    for (int i = 0; i < 10; ++i)
+        v.insert(v.end(), src.begin(), src.end());
+
+    cout << "10 bulk inserts of " << n << " ints: " << alloc_count << " allocations" << endl;
+}
+
+
+// 模拟一次请求：创建许多短命的小Vec<int>，请求结束时全部销毁
+template<typename V>
+int fake_request(const V& proto)
+{
+    int sum = 0;
+    for (int i = 0; i < 64; ++i)
+    {
+        V v(proto); //用proto拷贝构造，从而沿用同一个分配器
+        for (int j = 0; j < 16 + i % 8; ++j)
+            v.push_back(j);
+        sum += v.back();
+    }
+    return sum;
+}
+
+
+void bench_request_churn(size_t requests)
+{
+    int sum = 0;
+
+    alloc_count = 0;
+    auto start = chrono::steady_clock::now();
+    for (size_t r = 0; r < requests; ++r)
+        sum += fake_request(Vec<int>());
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    cout << "per-request churn, allocator<int>: " << alloc_count << " allocations, " << ms << " ms" << endl;
+
+    Arena arena;
+    Vec<int, DoubleGrowth, ArenaAllocator<int> > proto((ArenaAllocator<int>(arena)));
+    alloc_count = 0;
+    start = chrono::steady_clock::now();
+    for (size_t r = 0; r < requests; ++r)
+    {
+        sum += fake_request(proto);
+        arena.reset(); //请求结束，一次性释放
+    }
+    ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    cout << "per-request churn, ArenaAllocator<int>: " << alloc_count << " allocations, " << ms << " ms (" << sum << ")" << endl;
+}
+
+
+int main(int argc, char* argv[])
+{
+    size_t n = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000000;
+
+    bench_grow<CopyOnGrowString>("Vec<string> copy on grow", n);
+    bench_grow<string>("Vec<string> move on grow", n);
+
+    bench_growth_policy<DoubleGrowth>("Vec<int> 2x growth", n);
+    bench_growth_policy<OneAndHalfGrowth>("Vec<int> 1.5x growth", n);
+    bench_growth_policy<SizeClassGrowth>("Vec<int> size class growth", n);
+    bench_bulk_insert(n);
+    bench_request_churn(n / 100);
+}
+
+#endif // BENCHMARK
+
+#endif // VEC_CPP
@@ -1,195 +1,1121 @@
-#include <iostream>
-#include <crtdbg.h>
-#include <assert.h>
-
-#define DEBUG
-
-using namespace std;
-
-template<typename T>
-class sharedPtr
-{
-	T* pt;
-	size_t* count;
-	//由于多个sharedPtr实例会共享一个对象，当其中一个实例析构时，如果使用size_t而不是指针
-	//那么其余的实例无法感知count的变动
-
-public:
-	sharedPtr() : pt(nullptr), count(new size_t(1)) {}
-
-	explicit sharedPtr(T* t) : pt(t), count(new size_t(1)) {} //不允许用T* t隐式初始化
-
-	sharedPtr(const sharedPtr& p) : pt(p.pt), count(p.count) { ++(*count); } //允许用拷贝构造函数隐式初始化
-
-	~sharedPtr();
-
-	sharedPtr& operator=(const sharedPtr& p);
-
-	T& operator*();
-
-	T* operator->();
-
-	operator bool() const { return (pt != nullptr); }
-
-	void make_unique();
-
-	bool unique() const { return (*count) == 1; }
-
-	size_t use_count() const { return (*count); }
-
-	T* get() { return pt; }
-
-};
-
-/*相关操作的函数*/
-
-template<typename T>
-sharedPtr<T>& make_shared(T args)
-{
-	return sharedPtr<T>(&args);
-}
-
-template<typename T>
-sharedPtr<T>& make_shared()
-{
-	return sharedPtr<T>();
-}
-
-
-/*辅助函数*/
-
-//对于含有clone函数的对象，我们调用这个函数
-template<typename T>
-T* clone(const T* pt)
-{
-	return pt->clone();
-}
-
-
-//偏特化
-//对于不含有clone函数的对象，我们调用这个函数
-//以Vec<char>类型为例
-template<>
-int* clone(const int* pt)
-{
-	return new int(*pt);
-}
-
-
-/*成员函数的实现*/
-
-template<typename T>
-sharedPtr<T>::~sharedPtr()
-{
-
-	if (--(*count) == 0)
-	{
-#ifdef DEBUG
-		cout << "done" << endl;
-#endif // DEBUG
-
-		delete pt;
-		pt = nullptr;
-		delete count;
-		count = nullptr;
-	}
-}
-
-
-template<typename T>
-sharedPtr<T>& sharedPtr<T>::operator=(const sharedPtr& p)
-{
-	if (&p == this)
-		return *this;
-
-	if (--(*count) == 0)
-	{
-		delete pt;
-		delete count;
-#ifdef DEBUG
-		cout << "done" << endl;
-#endif // DEBUG
-	}
-
-	++(*p.count); //改变的是p.count指向的对象，而不是p的成员，所以可以用const
-
-	pt = p.pt;
-	count = p.count;
-
-	return *this;
-}
-
-
-template<typename T>
-T& sharedPtr<T>::operator*()
-{
-	if (pt == nullptr)
-		throw runtime_error("unbund sharedPtr\n");
-	else
-		return *pt;
-}
-
-
-template<typename T>
-T* sharedPtr<T>::operator->()
-{
-	if (pt == nullptr)
-		throw runtime_error("unbund sharedPtr\n");
-	else
-		return pt;
-}
-
-
-template<typename T>
-void sharedPtr<T>::make_unique()
-{
-	if ((*count) > 1)
-	{
-		--(*count);
-		pt = pt ? clone(pt) : nullptr;
-		count = new size_t(1);
-	}
-}
-
-
-/* 测试代码 */
-#ifdef DEBUG
-
-int main(int argc, char* argv[])
-{
-	{
-		//_CrtSetBreakAlloc(159);
-		sharedPtr<int> p1(new int(0));
-		assert(p1.unique() == true);
-		assert(p1.use_count() == 1);
-		p1 = p1;
-
-		sharedPtr<int> p2(p1);
-		assert(p1.unique() == false);
-		assert(p2.use_count() == 2);
-
-		sharedPtr<string> p3(new string("hello world"));
-		string a = (*p3);
-		size_t b = p3->size();
-		assert(a == "hello world");
-		assert(b == 11);
-
-		sharedPtr<char> p4(new char('a'));
-		char* c = p4.get();
-		assert(*c == 'a');
-
-		sharedPtr<int> p5(new int(5));
-		p5 = p1;
-
-		{
-			sharedPtr<int> p6(new int(9));
-		}
-	}
-
-	_CrtDumpMemoryLeaks();
-	//由于该检测手法实在main函数推出前检测，而此时各个类实例还没出作用域
-	//所以一直会存在内存泄漏，解决方法就是多加一层括号
-}
-
-#endif // DEBUG
-
+#ifndef SHAREDPTR_CPP
+#define SHAREDPTR_CPP
+
+#include <iostream>
+#include <atomic>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <stdexcept>
+#include <crtdbg.h>
+#include <assert.h>
+
+#ifndef BENCHMARK
+#define DEBUG
+#endif
+
+using namespace std;
+
+
+/*引用计数的策略*/
+
+//原子计数：指向同一对象的不同sharedPtr可以在不同线程中同时拷贝、析构
+//增加计数时已经持有一个引用，对象不会在此期间被释放，所以不需要同步，用relaxed即可
+//减少计数用acq_rel：release保证本线程对对象的修改在计数减少之前完成，acquire保证最后一个线程释放对象时能看到这些修改
+struct AtomicCount
+{
+	atomic<size_t> n;
+
+	explicit AtomicCount(size_t v) : n(v) {}
+
+	void increment() { n.fetch_add(1, memory_order_relaxed); }
+
+	size_t decrement() { return n.fetch_sub(1, memory_order_acq_rel) - 1; } //返回减少之后的值
+
+	//计数不为0时才增加，weakPtr::lock用它避免复活一个已经开始析构的对象
+	bool increment_if_nonzero()
+	{
+		size_t v = n.load(memory_order_relaxed);
+		while (v != 0 && !n.compare_exchange_weak(v, v + 1, memory_order_acq_rel, memory_order_relaxed))
+			;
+		return v != 0;
+	}
+
+	size_t load() const { return n.load(memory_order_relaxed); }
+};
+
+
+//普通计数：只在单线程中使用时没有原子操作的开销
+struct PlainCount
+{
+	size_t n;
+
+	explicit PlainCount(size_t v) : n(v) {}
+
+	void increment() { ++n; }
+
+	size_t decrement() { return --n; }
+
+	bool increment_if_nonzero() { return n != 0 && ++n; }
+
+	size_t load() const { return n; }
+};
+
+
+/*控制块*/
+
+//控制块保存引用计数，并负责释放对象和它自己；不同的创建方式对应不同的派生类，sharedPtr只通过虚函数使用它们
+//strong为0时析构对象，weak为0时释放控制块；所有sharedPtr合起来只占weak中的1，这样sharedPtr的拷贝只修改strong
+template<typename Count>
+struct CtrlBlock
+{
+	Count strong;
+	Count weak;
+
+	CtrlBlock() : strong(1), weak(1) {}
+
+	virtual ~CtrlBlock() {}
+
+	virtual void dispose() = 0; //析构对象
+
+	virtual void destroy() = 0; //释放控制块本身
+};
+
+
+//对象和控制块分别分配：sharedPtr(new T)时使用
+template<typename T, typename Count>
+struct PtrBlock : CtrlBlock<Count>
+{
+	T* pt;
+
+	explicit PtrBlock(T* t) : pt(t) {}
+
+	void dispose() { delete pt; }
+
+	void destroy() { delete this; }
+};
+
+
+//对象直接构造在控制块内部，一次分配同时得到对象和计数，二者通常位于同一缓存行
+//控制块和对象都由Alloc（重新绑定类型后）分配和构造；对象析构后，它占用的内存要等到weakPtr也都释放后才归还
+template<typename T, typename Count, typename Alloc>
+struct InplaceBlock : CtrlBlock<Count>
+{
+	typedef typename allocator_traits<Alloc>::template rebind_alloc<InplaceBlock> BlockAlloc;
+	typedef typename allocator_traits<Alloc>::template rebind_alloc<T> ValueAlloc;
+
+	typename aligned_storage<sizeof(T), alignof(T)>::type storage;
+	BlockAlloc alloc;
+
+	explicit InplaceBlock(const Alloc& a) : alloc(a) {}
+
+	T* get() { return reinterpret_cast<T*>(&storage); }
+
+	void dispose()
+	{
+		ValueAlloc a(alloc);
+		allocator_traits<ValueAlloc>::destroy(a, get());
+	}
+
+	void destroy()
+	{
+		BlockAlloc a(alloc); //先复制一份分配器，析构控制块之后还要用它释放内存
+		allocator_traits<BlockAlloc>::destroy(a, this);
+		allocator_traits<BlockAlloc>::deallocate(a, this, 1);
+	}
+};
+
+
+template<typename T, typename Count>
+class sharedPtr;
+
+template<typename T, typename Count>
+class weakPtr;
+
+template<typename T, typename Count = AtomicCount, typename Alloc, typename... Args>
+sharedPtr<T, Count> allocate_sharedPtr(const Alloc& a, Args&&... args);
+
+
+template<typename T, typename Count = AtomicCount>
+class sharedPtr
+{
+	T* pt;
+	CtrlBlock<Count>* ctrl;
+	//由于多个sharedPtr实例会共享一个对象，当其中一个实例析构时，如果计数不放在共享的控制块中
+	//那么其余的实例无法感知计数的变动
+
+	sharedPtr(T* t, CtrlBlock<Count>* c) : pt(t), ctrl(c) {}
+
+	void release();
+
+	template<typename U, typename C, typename A, typename... Args>
+	friend sharedPtr<U, C> allocate_sharedPtr(const A& a, Args&&... args);
+
+	friend class weakPtr<T, Count>;
+
+public:
+	sharedPtr() : pt(nullptr), ctrl(nullptr) {} //空指针没有控制块，不分配内存
+
+	explicit sharedPtr(T* t) : pt(t), ctrl(t ? new PtrBlock<T, Count>(t) : nullptr) {} //不允许用T* t隐式初始化
+
+	sharedPtr(const sharedPtr& p) : pt(p.pt), ctrl(p.ctrl) { if (ctrl) ctrl->strong.increment(); } //允许用拷贝构造函数隐式初始化
+
+	sharedPtr(sharedPtr&& p) noexcept : pt(p.pt), ctrl(p.ctrl) { p.pt = nullptr; p.ctrl = nullptr; } //直接接管p的引用，不修改计数
+
+	~sharedPtr() { release(); }
+
+	sharedPtr& operator=(const sharedPtr& p);
+
+	sharedPtr& operator=(sharedPtr&& p) noexcept;
+
+	void swap(sharedPtr& p) noexcept { std::swap(pt, p.pt); std::swap(ctrl, p.ctrl); }
+
+	void reset() { release(); }
+
+	void reset(T* t) { sharedPtr(t).swap(*this); } //先创建新的控制块，分配失败时*this保持不变
+
+	T& operator*();
+
+	T* operator->();
+
+	operator bool() const { return (pt != nullptr); }
+
+	void make_unique();
+
+	bool unique() const { return use_count() == 1; }
+
+	size_t use_count() const { return ctrl ? ctrl->strong.load() : 0; } //多线程时只是一个瞬间的快照
+
+	T* get() const { return pt; }
+
+};
+
+/*相关操作的函数*/
+
+//对象和控制块一起用a分配，对象用args原地构造，不经过new T
+//不命名为allocate_shared/make_shared：各文件都using namespace std，会和<memory>中的同名函数产生歧义
+template<typename T, typename Count, typename Alloc, typename... Args>
+sharedPtr<T, Count> allocate_sharedPtr(const Alloc& a, Args&&... args)
+{
+	typedef InplaceBlock<T, Count, Alloc> Block;
+	typename Block::BlockAlloc blockAlloc(a);
+	Block* block = allocator_traits<typename Block::BlockAlloc>::allocate(blockAlloc, 1);
+	try
+	{
+		allocator_traits<typename Block::BlockAlloc>::construct(blockAlloc, block, a);
+	}
+	catch (...)
+	{
+		allocator_traits<typename Block::BlockAlloc>::deallocate(blockAlloc, block, 1);
+		throw;
+	}
+
+	try
+	{
+		typename Block::ValueAlloc valueAlloc(a);
+		allocator_traits<typename Block::ValueAlloc>::construct(valueAlloc, block->get(), std::forward<Args>(args)...);
+	}
+	catch (...)
+	{
+		block->destroy(); //对象没有构造成功，只释放控制块
+		throw;
+	}
+
+	return sharedPtr<T, Count>(block->get(), block);
+}
+
+
+template<typename T, typename Count = AtomicCount, typename... Args>
+sharedPtr<T, Count> make_sharedPtr(Args&&... args)
+{
+	return allocate_sharedPtr<T, Count>(allocator<T>(), std::forward<Args>(args)...);
+}
+
+
+//弱引用：不阻止对象被析构，只保证控制块还在，可以查询对象是否已经析构
+//用于缓存，以及打破环状引用（例如子节点用weakPtr指向父节点）
+template<typename T, typename Count = AtomicCount>
+class weakPtr
+{
+	T* pt;
+	CtrlBlock<Count>* ctrl;
+
+	void release();
+
+public:
+	weakPtr() : pt(nullptr), ctrl(nullptr) {}
+
+	weakPtr(const sharedPtr<T, Count>& p) : pt(p.pt), ctrl(p.ctrl) { if (ctrl) ctrl->weak.increment(); }
+
+	weakPtr(const weakPtr& w) : pt(w.pt), ctrl(w.ctrl) { if (ctrl) ctrl->weak.increment(); }
+
+	weakPtr(weakPtr&& w) noexcept : pt(w.pt), ctrl(w.ctrl) { w.pt = nullptr; w.ctrl = nullptr; }
+
+	~weakPtr() { release(); }
+
+	weakPtr& operator=(const weakPtr& w) { weakPtr(w).swap(*this); return *this; }
+
+	weakPtr& operator=(weakPtr&& w) noexcept { weakPtr(std::move(w)).swap(*this); return *this; }
+
+	weakPtr& operator=(const sharedPtr<T, Count>& p) { weakPtr(p).swap(*this); return *this; }
+
+	void swap(weakPtr& w) noexcept { std::swap(pt, w.pt); std::swap(ctrl, w.ctrl); }
+
+	void reset() { release(); }
+
+	sharedPtr<T, Count> lock() const; //对象已经析构时返回空的sharedPtr
+
+	bool expired() const { return use_count() == 0; }
+
+	size_t use_count() const { return ctrl ? ctrl->strong.load() : 0; }
+
+};
+
+
+/*侵入式引用计数*/
+
+//计数放在对象内部：class Message : public refCounted<Message> { ... };
+//不需要控制块，指针只有一个字长，拷贝指针只访问对象本身所在的缓存行；对象必须用new创建
+//多线程共享时用AtomicCount，只在单线程中使用时可以选择PlainCount
+template<typename Derived, typename Count = AtomicCount>
+class refCounted
+{
+	mutable Count refs;
+
+protected:
+	refCounted() : refs(0) {}
+
+	refCounted(const refCounted&) : refs(0) {} //拷贝出来的是新对象，还没有被任何指针引用
+
+	refCounted& operator=(const refCounted&) { return *this; }
+
+	~refCounted() {} //不是虚函数，通过Derived*释放
+
+public:
+	void add_ref() const { refs.increment(); }
+
+	void release_ref() const
+	{
+		if (refs.decrement() == 0)
+			delete static_cast<const Derived*>(this);
+	}
+
+	size_t ref_count() const { return refs.load(); }
+};
+
+
+//T需要提供add_ref和release_ref，通常从refCounted<T>派生
+template<typename T>
+class intrusivePtr
+{
+	T* pt;
+
+public:
+	intrusivePtr() : pt(nullptr) {}
+
+	explicit intrusivePtr(T* t) : pt(t) { if (pt) pt->add_ref(); } //计数在对象中，同一个T*可以多次构造intrusivePtr
+
+	intrusivePtr(const intrusivePtr& p) : pt(p.pt) { if (pt) pt->add_ref(); }
+
+	intrusivePtr(intrusivePtr&& p) noexcept : pt(p.pt) { p.pt = nullptr; }
+
+	~intrusivePtr() { if (pt) pt->release_ref(); }
+
+	intrusivePtr& operator=(const intrusivePtr& p) { intrusivePtr(p).swap(*this); return *this; }
+
+	intrusivePtr& operator=(intrusivePtr&& p) noexcept { intrusivePtr(std::move(p)).swap(*this); return *this; }
+
+	void swap(intrusivePtr& p) noexcept { std::swap(pt, p.pt); }
+
+	void reset() { intrusivePtr().swap(*this); }
+
+	void reset(T* t) { intrusivePtr(t).swap(*this); }
+
+	T& operator*() const;
+
+	T* operator->() const;
+
+	operator bool() const { return (pt != nullptr); }
+
+	size_t use_count() const { return pt ? pt->ref_count() : 0; }
+
+	T* get() const { return pt; }
+
+};
+
+
+/*辅助函数*/
+
+//对于含有clone函数的对象，我们调用这个函数
+template<typename T>
+T* clone(const T* pt)
+{
+	return pt->clone();
+}
+
+
+//偏特化
+//对于不含有clone函数的对象，我们调用这个函数
+//以Vec<char>类型为例
+template<>
+int* clone(const int* pt)
+{
+	return new int(*pt);
+}
+
+
+/*成员函数的实现*/
+
+//放弃对当前对象的引用，最后一个引用负责释放对象和控制块
+template<typename T, typename Count>
+void sharedPtr<T, Count>::release()
+{
+	if (ctrl && ctrl->strong.decrement() == 0)
+	{
+		ctrl->dispose();
+		if (ctrl->weak.decrement() == 0)
+			ctrl->destroy();
+	}
+	pt = nullptr;
+	ctrl = nullptr;
+}
+
+
+template<typename T, typename Count>
+sharedPtr<T, Count>& sharedPtr<T, Count>::operator=(const sharedPtr& p)
+{
+	if (&p == this)
+		return *this;
+
+	if (p.ctrl)
+		p.ctrl->strong.increment(); //改变的是p.ctrl指向的对象，而不是p的成员，所以可以用const；先增加再减少，p和*this共享对象时也不会提前释放
+
+	release();
+	pt = p.pt;
+	ctrl = p.ctrl;
+
+	return *this;
+}
+
+
+template<typename T, typename Count>
+sharedPtr<T, Count>& sharedPtr<T, Count>::operator=(sharedPtr&& p) noexcept
+{
+	if (&p == this)
+		return *this;
+
+	release();
+	pt = p.pt;
+	ctrl = p.ctrl;
+	p.pt = nullptr;
+	p.ctrl = nullptr;
+
+	return *this;
+}
+
+
+template<typename T, typename Count>
+T& sharedPtr<T, Count>::operator*()
+{
+	if (pt == nullptr)
+		throw runtime_error("unbund sharedPtr\n");
+	else
+		return *pt;
+}
+
+
+template<typename T, typename Count>
+T* sharedPtr<T, Count>::operator->()
+{
+	if (pt == nullptr)
+		throw runtime_error("unbund sharedPtr\n");
+	else
+		return pt;
+}
+
+
+//先拷贝对象、分配新的控制块，再按普通路径放弃原来的引用：拷贝期间仍持有引用，其他线程不会释放原对象
+//拷贝或分配抛出异常时*this保持不变；判断之后其他线程可能释放了引用，这时会多拷贝一次，但结果仍然正确
+template<typename T, typename Count>
+void sharedPtr<T, Count>::make_unique()
+{
+	if (ctrl && ctrl->strong.load() > 1)
+	{
+		T* copy = pt ? clone(pt) : nullptr;
+		CtrlBlock<Count>* block;
+		try
+		{
+			block = new PtrBlock<T, Count>(copy);
+		}
+		catch (...)
+		{
+			delete copy;
+			throw;
+		}
+
+		release();
+		pt = copy;
+		ctrl = block;
+	}
+}
+
+
+/*weakPtr成员函数的实现*/
+
+template<typename T, typename Count>
+void weakPtr<T, Count>::release()
+{
+	if (ctrl && ctrl->weak.decrement() == 0)
+		ctrl->destroy();
+	pt = nullptr;
+	ctrl = nullptr;
+}
+
+
+//先检查再增加不是原子的，另一个线程可能恰好在两步之间释放了最后一个引用，所以只在计数不为0时增加
+template<typename T, typename Count>
+sharedPtr<T, Count> weakPtr<T, Count>::lock() const
+{
+	if (ctrl && ctrl->strong.increment_if_nonzero())
+		return sharedPtr<T, Count>(pt, ctrl);
+
+	return sharedPtr<T, Count>();
+}
+
+
+/*intrusivePtr成员函数的实现*/
+
+template<typename T>
+T& intrusivePtr<T>::operator*() const
+{
+	if (pt == nullptr)
+		throw runtime_error("unbund intrusivePtr\n");
+	else
+		return *pt;
+}
+
+
+template<typename T>
+T* intrusivePtr<T>::operator->() const
+{
+	if (pt == nullptr)
+		throw runtime_error("unbund intrusivePtr\n");
+	else
+		return pt;
+}
+
+
+/* 测试代码 */
+#if defined(DEBUG) && !defined(NO_MAIN)
+
+#include <thread>
+
+//记录分配次数和未释放的字节数的分配器，重新绑定到其他类型后仍然记在一起
+struct AllocStats
+{
+	static int allocations;
+	static long long bytes;
+};
+
+int AllocStats::allocations = 0;
+long long AllocStats::bytes = 0;
+
+
+template<typename T>
+struct CountingAlloc : AllocStats
+{
+	typedef T value_type;
+
+	CountingAlloc() {}
+
+	template<typename U>
+	CountingAlloc(const CountingAlloc<U>&) {}
+
+	T* allocate(size_t n) { ++allocations; bytes += n * sizeof(T); return static_cast<T*>(::operator new(n * sizeof(T))); }
+
+	void deallocate(T* p, size_t n) { bytes -= n * sizeof(T); ::operator delete(p); }
+
+	template<typename U>
+	bool operator==(const CountingAlloc<U>&) const { return true; }
+
+	template<typename U>
+	bool operator!=(const CountingAlloc<U>&) const { return false; }
+};
+
+
+struct Widget
+{
+	static int alive;
+	int a;
+	string b;
+
+	Widget(int x, const string& y) : a(x), b(y) { if (x < 0) throw "negative"; ++alive; }
+
+	~Widget() { --alive; }
+};
+
+int Widget::alive = 0;
+
+
+//父节点持有子节点的sharedPtr，子节点用weakPtr指回父节点，不形成引用环
+//clone可以被设置为抛出异常，用来测试make_unique的异常安全
+struct Fragile
+{
+	static bool fail;
+	int v;
+
+	explicit Fragile(int x) : v(x) {}
+
+	Fragile* clone() const
+	{
+		if (fail)
+			throw "clone failed";
+		return new Fragile(v);
+	}
+};
+
+bool Fragile::fail = false;
+
+
+struct TreeNode
+{
+	static int alive;
+	weakPtr<TreeNode> parent;
+	sharedPtr<TreeNode> child;
+
+	TreeNode() { ++alive; }
+
+	~TreeNode() { --alive; }
+};
+
+int TreeNode::alive = 0;
+
+
+struct Message : refCounted<Message>
+{
+	static int alive;
+	int id;
+
+	explicit Message(int i) : id(i) { ++alive; }
+
+	Message(const Message& m) : refCounted<Message>(m), id(m.id) { ++alive; }
+
+	~Message() { --alive; }
+};
+
+int Message::alive = 0;
+
+
+struct LocalMessage : refCounted<LocalMessage, PlainCount>
+{
+	int id;
+
+	explicit LocalMessage(int i) : id(i) {}
+};
+
+
+int main(int argc, char* argv[])
+{
+	{
+		//_CrtSetBreakAlloc(159);
+		sharedPtr<int> p1(new int(0));
+		assert(p1.unique() == true);
+		assert(p1.use_count() == 1);
+		p1 = p1;
+
+		sharedPtr<int> p2(p1);
+		assert(p1.unique() == false);
+		assert(p2.use_count() == 2);
+
+		sharedPtr<string> p3(new string("hello world"));
+		string a = (*p3);
+		size_t b = p3->size();
+		assert(a == "hello world");
+		assert(b == 11);
+
+		sharedPtr<char> p4(new char('a'));
+		char* c = p4.get();
+		assert(*c == 'a');
+
+		sharedPtr<int> p5(new int(5));
+		p5 = p1; //p5原来的对象在这里释放
+		assert(p1.use_count() == 3 && *p5 == 0);
+
+		{
+			sharedPtr<Widget> p6(new Widget(9, "nine"));
+			sharedPtr<Widget> p7(p6);
+			p6.reset();
+			assert(Widget::alive == 1); //还有p7引用，不释放
+		}
+		assert(Widget::alive == 0); //最后一个引用离开作用域时释放
+	}
+
+	{
+		//多个线程同时拷贝、析构指向同一对象的sharedPtr，计数最终回到1
+		sharedPtr<int> shared(new int(42));
+		thread workers[4];
+		for (int t = 0; t < 4; ++t)
+			workers[t] = thread([shared]() {
+				for (int i = 0; i < 100000; ++i)
+				{
+					sharedPtr<int> a(shared);
+					sharedPtr<int> b;
+					b = a;
+					assert(*b == 42);
+				}
+			});
+		for (int t = 0; t < 4; ++t)
+			workers[t].join();
+		assert(shared.unique());
+
+		sharedPtr<int, PlainCount> p7(new int(7)); //单线程使用的普通计数
+		sharedPtr<int, PlainCount> p8(p7);
+		assert(p8.use_count() == 2 && *p8 == 7);
+		p8 = sharedPtr<int, PlainCount>(new int(8));
+		assert(p7.unique() && *p8 == 8);
+
+		sharedPtr<int> p9(new int(9));
+		sharedPtr<int> p10(p9);
+		p10.make_unique(); //重新拷贝一份对象
+		*p10 = 10;
+		assert(*p9 == 9 && p9.unique() && p10.unique());
+
+		//拷贝失败时不放弃原来的引用，计数不变
+		sharedPtr<Fragile> f1(new Fragile(1));
+		sharedPtr<Fragile> f2(f1);
+		Fragile::fail = true;
+		bool thrown = false;
+		try { f2.make_unique(); }
+		catch (const char*) { thrown = true; }
+		Fragile::fail = false;
+		assert(thrown && f2.get() == f1.get() && f1.use_count() == 2);
+		f2.make_unique();
+		assert(f2.get() != f1.get() && f1.unique() && f2.unique() && f2->v == 1);
+
+		//一个线程拷贝对象的同时，其他线程放弃它们的引用，拷贝期间原对象不能被释放
+		for (int round = 0; round < 200; ++round)
+		{
+			sharedPtr<int> owner(new int(round));
+			sharedPtr<int> other(owner);
+			sharedPtr<int> mine(owner);
+			thread t1([&owner]() { owner.reset(); });
+			thread t2([&other]() { other.reset(); });
+			thread t3([&mine, round]() { mine.make_unique(); assert(*mine == round); });
+			t1.join();
+			t2.join();
+			t3.join();
+			assert(mine.unique() && *mine == round);
+		}
+	}
+
+	{
+		//对象用参数原地构造，和计数在同一次分配中
+		sharedPtr<Widget> w1 = make_sharedPtr<Widget>(1, "one");
+		assert(w1->a == 1 && w1->b == "one" && w1.unique() && Widget::alive == 1);
+		sharedPtr<Widget> w2(w1);
+		assert(w2.use_count() == 2);
+		w1 = make_sharedPtr<Widget>(2, "two");
+		assert(Widget::alive == 2 && w2.unique() && w1->b == "two");
+		sharedPtr<int, PlainCount> i1 = make_sharedPtr<int, PlainCount>(5);
+		sharedPtr<int> i2 = make_sharedPtr<int>(); //值初始化
+		assert(*i1 == 5 && *i2 == 0);
+
+		//全部内存都经过分配器，而且只分配一次
+		{
+			CountingAlloc<Widget> alloc;
+			sharedPtr<Widget> w3 = allocate_sharedPtr<Widget>(alloc, 3, "three");
+			sharedPtr<Widget> w4(w3);
+			assert(AllocStats::allocations == 1 && AllocStats::bytes >= (long long)sizeof(Widget));
+			assert(w4->a == 3 && Widget::alive == 3);
+		}
+		assert(Widget::alive == 2 && AllocStats::bytes == 0);
+
+		//构造函数抛出异常时控制块被释放
+		bool thrown = false;
+		try { sharedPtr<Widget> w5 = allocate_sharedPtr<Widget>(CountingAlloc<Widget>(), -1, "bad"); }
+		catch (const char*) { thrown = true; }
+		assert(thrown && Widget::alive == 2 && AllocStats::allocations == 2 && AllocStats::bytes == 0);
+	}
+	assert(Widget::alive == 0);
+
+	{
+		//空指针不分配控制块，计数为0
+		sharedPtr<int> n1;
+		sharedPtr<int> n2(n1);
+		sharedPtr<int> n3((int*)nullptr);
+		assert(!n1 && !n2 && !n3 && n1.use_count() == 0 && !n1.unique() && n1.get() == nullptr);
+		n2 = n1;
+		n1.make_unique();
+		assert(n1.use_count() == 0);
+
+		//移动不修改计数，被移动的指针变为空
+		sharedPtr<Widget> m1 = make_sharedPtr<Widget>(1, "one");
+		Widget* raw = m1.get();
+		sharedPtr<Widget> m2(std::move(m1));
+		assert(!m1 && m1.use_count() == 0 && m2.unique() && m2.get() == raw);
+		sharedPtr<Widget> m3 = make_sharedPtr<Widget>(3, "three");
+		m3 = std::move(m2); //m3原来的对象被释放
+		assert(Widget::alive == 1 && m3.get() == raw && !m2);
+		m3 = std::move(m3);
+		assert(m3.unique() && m3->a == 1);
+
+		sharedPtr<Widget> m4;
+		m4.swap(m3);
+		assert(!m3 && m4->a == 1);
+		m4.reset(new Widget(4, "four"));
+		assert(Widget::alive == 1 && m4->a == 4);
+		m4.reset();
+		assert(!m4 && Widget::alive == 0);
+		n1 = std::move(n2); //空指针之间移动
+		assert(!n1 && !n2);
+	}
+
+	{
+		weakPtr<Widget> w0;
+		assert(w0.expired() && !w0.lock());
+
+		sharedPtr<Widget> s1(new Widget(1, "one"));
+		weakPtr<Widget> w1(s1);
+		weakPtr<Widget> w2 = w1;
+		assert(!w1.expired() && w1.use_count() == 1 && s1.unique()); //weakPtr不增加strong计数
+		{
+			sharedPtr<Widget> s2 = w2.lock();
+			assert(s2 && s2->a == 1 && s1.use_count() == 2);
+		}
+		s1.reset(); //对象析构，控制块仍被w1和w2持有
+		assert(Widget::alive == 0 && w1.expired() && w2.expired() && !w1.lock());
+
+		//对象在控制块内部时，对象先析构，内存等weakPtr释放后才归还
+		CountingAlloc<Widget> alloc;
+		sharedPtr<Widget> s3 = allocate_sharedPtr<Widget>(alloc, 3, "three");
+		long long held = AllocStats::bytes;
+		w1 = s3;
+		s3.reset();
+		assert(Widget::alive == 0 && w1.expired() && AllocStats::bytes == held);
+		w1.reset();
+		assert(AllocStats::bytes == 0);
+
+		sharedPtr<TreeNode> root(new TreeNode);
+		root->child = sharedPtr<TreeNode>(new TreeNode);
+		root->child->parent = root;
+		assert(root->child->parent.lock().get() == root.get());
+		assert(root.unique()); //lock返回的临时对象已经析构
+		weakPtr<TreeNode> leaf = root->child;
+		root.reset();
+		assert(TreeNode::alive == 0 && leaf.expired());
+
+		//一个线程释放最后一个引用的同时，其他线程lock：要么得到完整的对象，要么得到空指针
+		for (int round = 0; round < 200; ++round)
+		{
+			sharedPtr<Widget> owner = make_sharedPtr<Widget>(round, "race");
+			weakPtr<Widget> watcher(owner);
+			thread t1([&owner]() { owner.reset(); });
+			thread t2([&watcher, round]() {
+				for (int i = 0; i < 100; ++i)
+				{
+					sharedPtr<Widget> got = watcher.lock();
+					if (got)
+						assert(got->a == round && got->b == "race");
+				}
+			});
+			t1.join();
+			t2.join();
+			assert(watcher.expired() && Widget::alive == 0);
+		}
+	}
+
+	{
+		static_assert(sizeof(intrusivePtr<Message>) == sizeof(Message*), "intrusivePtr is one pointer wide");
+		intrusivePtr<Message> m1(new Message(1));
+		assert(m1.use_count() == 1 && m1->id == 1 && (*m1).id == 1);
+		intrusivePtr<Message> m2(m1);
+		intrusivePtr<Message> m3(m1.get()); //从原始指针再次构造，共享同一个计数
+		assert(m1.use_count() == 3);
+		m2 = std::move(m3);
+		assert(!m3 && m1.use_count() == 2);
+
+		intrusivePtr<Message> m4(new Message(*m1)); //拷贝对象不拷贝计数
+		assert(m4.use_count() == 1 && m4->id == 1 && Message::alive == 2);
+		m4 = m1;
+		assert(Message::alive == 1 && m1.use_count() == 3);
+		m1.reset();
+		m2.reset(new Message(2));
+		assert(Message::alive == 2 && m4.use_count() == 1 && m2->id == 2);
+		m4.swap(m2);
+		assert(m4->id == 2 && m2->id == 1);
+
+		intrusivePtr<Message> n1;
+		bool thrown = false;
+		try { n1->id = 0; }
+		catch (const runtime_error&) { thrown = true; }
+		assert(thrown && n1.use_count() == 0 && !n1);
+
+		intrusivePtr<LocalMessage> l1(new LocalMessage(3));
+		intrusivePtr<LocalMessage> l2 = l1;
+		assert(l2.use_count() == 2 && l2->id == 3);
+
+		//多个线程同时拷贝、释放
+		thread workers[4];
+		for (int t = 0; t < 4; ++t)
+			workers[t] = thread([m4]() {
+				for (int i = 0; i < 100000; ++i)
+				{
+					intrusivePtr<Message> copy(m4);
+					assert(copy->id == 2);
+				}
+			});
+		for (int t = 0; t < 4; ++t)
+			workers[t].join();
+		assert(m4.use_count() == 1);
+	}
+	assert(Message::alive == 0);
+
+	_CrtDumpMemoryLeaks();
+	//由于该检测手法实在main函数推出前检测，而此时各个类实例还没出作用域
+	//所以一直会存在内存泄漏，解决方法就是多加一层括号
+}
+
+#endif // DEBUG
+
+
+/* 性能测试代码 */
+
+#if defined(BENCHMARK) && !defined(NO_MAIN)
+
+#pragma push_macro("NO_MAIN")
+#define NO_MAIN
+#include "Vec.cpp"
+#pragma pop_macro("NO_MAIN")
+#include <thread>
+#include <chrono>
+#include <cstdlib>
+
+double ms_since(chrono::steady_clock::time_point start)
+{
+	return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+//每个线程反复拷贝再析构同一个对象的sharedPtr，所有线程竞争同一个计数所在的缓存行
+template<typename Count>
+double copy_loop(const sharedPtr<int, Count>& shared, int threads, size_t iters)
+{
+	auto start = chrono::steady_clock::now();
+	thread* workers = new thread[threads];
+	for (int t = 0; t < threads; ++t)
+		workers[t] = thread([&shared, iters]() {
+			for (size_t i = 0; i < iters; ++i)
+			{
+				sharedPtr<int, Count> copy(shared);
+				if (*copy.get() != 1)
+					abort();
+			}
+		});
+	for (int t = 0; t < threads; ++t)
+		workers[t].join();
+	delete[] workers;
+	return ms_since(start);
+}
+
+
+struct Payload
+{
+	size_t key;
+	double weight;
+};
+
+
+//分别用new和make_sharedPtr创建n个对象，中间穿插其他大小的分配，模拟真实的堆
+//之后按打乱的顺序访问，每次同时读对象和计数：两次分配时这是两次缓存未命中，一次分配时通常只有一次
+template<typename Make>
+void bench_create(const char* name, size_t n, const Vec<size_t>& order, Make make)
+{
+	Vec<sharedPtr<Payload> > ptrs;
+	Vec<char*> noise;
+	ptrs.reserve(n);
+	noise.reserve(n);
+	auto start = chrono::steady_clock::now();
+	for (size_t i = 0; i < n; ++i)
+	{
+		ptrs.push_back(make(i));
+		noise.push_back(new char[16 + i % 48]);
+	}
+	double create_ms = ms_since(start);
+
+	start = chrono::steady_clock::now();
+	size_t acc = 0;
+	for (size_t i = 0; i < n; ++i)
+	{
+		sharedPtr<Payload>& p = ptrs[order[i]];
+		acc += p->key + p.use_count();
+	}
+	double deref_ms = ms_since(start);
+
+	start = chrono::steady_clock::now();
+	ptrs.clear();
+	double destroy_ms = ms_since(start);
+	for (size_t i = 0; i < n; ++i)
+		delete[] noise[i];
+
+	cout << name << ": create " << create_ms << " ms, random deref " << deref_ms << " ms, destroy " << destroy_ms << " ms (" << acc << ")" << endl;
+}
+
+
+//只能拷贝的包装：模拟没有移动构造函数时，Vec扩容每搬运一个元素都要增加一次计数、再减少一次
+struct CopyOnlyPtr
+{
+	sharedPtr<Payload> p;
+
+	CopyOnlyPtr(const sharedPtr<Payload>& q) : p(q) {}
+
+	CopyOnlyPtr(const CopyOnlyPtr& c) : p(c.p) {}
+};
+
+
+//不预留容量，逐个push_back，扩容时搬运已有的元素
+template<typename P>
+double bench_growth(const sharedPtr<Payload>& shared, size_t n)
+{
+	auto start = chrono::steady_clock::now();
+	Vec<P> v;
+	for (size_t i = 0; i < n; ++i)
+		v.push_back(P(shared));
+	return ms_since(start);
+}
+
+
+//缓存按下标保存对象：强引用缓存每次查找拷贝一个sharedPtr，弱引用缓存每次查找lock一次
+//之后对象的所有者释放一半的对象，弱引用缓存随之失效，强引用缓存则让它们一直存活
+void bench_cache(size_t n, size_t lookups)
+{
+	Vec<sharedPtr<Payload> > owners;
+	Vec<sharedPtr<Payload> > strong;
+	Vec<weakPtr<Payload> > weak;
+	for (size_t i = 0; i < n; ++i)
+	{
+		owners.push_back(make_sharedPtr<Payload>(Payload{ i, 1.0 }));
+		strong.push_back(owners[i]);
+		weak.push_back(weakPtr<Payload>(owners[i]));
+	}
+
+	size_t x = 12345, acc = 0;
+	auto start = chrono::steady_clock::now();
+	for (size_t i = 0; i < lookups; ++i)
+	{
+		x = x * 6364136223846793005ull + 1442695040888963407ull;
+		sharedPtr<Payload> p = strong[(x >> 16) % n];
+		acc += p->key;
+	}
+	double strong_ms = ms_since(start);
+
+	x = 12345;
+	start = chrono::steady_clock::now();
+	for (size_t i = 0; i < lookups; ++i)
+	{
+		x = x * 6364136223846793005ull + 1442695040888963407ull;
+		sharedPtr<Payload> p = weak[(x >> 16) % n].lock();
+		acc -= p->key;
+	}
+	double weak_ms = ms_since(start);
+
+	for (size_t i = 0; i < n; i += 2)
+		owners[i].reset();
+	size_t alive_strong = 0, alive_weak = 0;
+	for (size_t i = 0; i < n; ++i)
+		alive_strong += strong[i].unique(); //只剩缓存持有
+	strong.clear();
+	for (size_t i = 0; i < n; ++i)
+		alive_weak += !weak[i].expired();
+
+	cout << "cache of " << n << ", " << lookups << " lookups: sharedPtr copy " << strong_ms << " ms, weakPtr::lock " << weak_ms
+		<< " ms" << (acc == 0 ? "" : " (mismatch)") << "; after owners drop half: " << alive_strong << " kept alive only by strong cache, "
+		<< alive_weak << " still reachable through weak cache" << endl;
+}
+
+
+struct Msg : refCounted<Msg>
+{
+	size_t id;
+	char body[40];
+
+	explicit Msg(size_t i = 0) : id(i) {}
+};
+
+struct LocalMsg : refCounted<LocalMsg, PlainCount>
+{
+	size_t id;
+	char body[40];
+
+	explicit LocalMsg(size_t i = 0) : id(i) {}
+};
+
+
+//创建n个消息，把指针整体拷贝一份（每个元素一次计数增加），再依次释放两份
+template<typename P, typename Make>
+void bench_message(const char* name, size_t n, Make make)
+{
+	auto start = chrono::steady_clock::now();
+	Vec<P> v;
+	v.reserve(n);
+	for (size_t i = 0; i < n; ++i)
+		v.push_back(make(i));
+	double create_ms = ms_since(start);
+
+	start = chrono::steady_clock::now();
+	Vec<P> copy(v);
+	double copy_ms = ms_since(start);
+
+	start = chrono::steady_clock::now();
+	copy.clear();
+	v.clear();
+	double destroy_ms = ms_since(start);
+
+	cout << name << " (" << sizeof(P) << " bytes): create " << create_ms << " ms, copy " << copy_ms << " ms, destroy " << destroy_ms << " ms" << endl;
+}
+
+
+int main(int argc, char* argv[])
+{
+	size_t iters = argc > 1 ? strtoul(argv[1], nullptr, 10) : 10000000;
+	int cores = int(thread::hardware_concurrency());
+	if (cores < 1)
+		cores = 1;
+
+	sharedPtr<int, PlainCount> plain(new int(1));
+	sharedPtr<int> atomic_count(new int(1));
+	cout << "copy+destroy x" << iters << " per thread" << endl;
+	cout << "1 thread: PlainCount " << copy_loop(plain, 1, iters) << " ms, AtomicCount " << copy_loop(atomic_count, 1, iters) << " ms" << endl;
+	for (int threads = 2; threads <= cores; threads = (threads * 2 > cores && threads < cores) ? cores : threads * 2) //PlainCount不能跨线程共享；最后一行总是用全部核心
+		cout << threads << " threads: AtomicCount " << copy_loop(atomic_count, threads, iters) << " ms" << endl;
+
+	size_t n = iters / 4;
+	Vec<size_t> order;
+	for (size_t i = 0; i < n; ++i)
+		order.push_back(i);
+	srand(1);
+	for (size_t i = n - 1; i > 0; --i)
+		swap(order[i], order[(size_t(rand()) * RAND_MAX + rand()) % (i + 1)]);
+	bench_create("sharedPtr(new T)", n, order, [](size_t i) { return sharedPtr<Payload>(new Payload{ i, 1.0 }); });
+	bench_create("make_sharedPtr", n, order, [](size_t i) { return make_sharedPtr<Payload>(Payload{ i, 1.0 }); });
+
+	sharedPtr<Payload> shared = make_sharedPtr<Payload>(Payload{ 0, 1.0 });
+	cout << "Vec growth to " << n << " elements: copy-only " << bench_growth<CopyOnlyPtr>(shared, n)
+		<< " ms, with move " << bench_growth<sharedPtr<Payload> >(shared, n) << " ms" << endl;
+	auto start = chrono::steady_clock::now();
+	{
+		Vec<sharedPtr<Payload> > nulls(n, sharedPtr<Payload>());
+	}
+	cout << n << " null sharedPtrs: " << ms_since(start) << " ms, no allocation" << endl;
+
+	bench_cache(1 << 16, iters);
+
+	struct PlainMsg { size_t id; char body[40]; };
+	bench_message<sharedPtr<PlainMsg> >("sharedPtr(new T)", n, [](size_t i) { return sharedPtr<PlainMsg>(new PlainMsg{ i, {} }); });
+	bench_message<sharedPtr<PlainMsg> >("make_sharedPtr", n, [](size_t i) { return make_sharedPtr<PlainMsg>(PlainMsg{ i, {} }); });
+	bench_message<intrusivePtr<Msg> >("intrusivePtr, AtomicCount", n, [](size_t i) { return intrusivePtr<Msg>(new Msg(i)); });
+	bench_message<intrusivePtr<LocalMsg> >("intrusivePtr, PlainCount", n, [](size_t i) { return intrusivePtr<LocalMsg>(new LocalMsg(i)); });
+}
+
+#endif // BENCHMARK
+
+#endif // SHAREDPTR_CPP